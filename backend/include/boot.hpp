@@ -0,0 +1,52 @@
+#pragma once
+
+/**
+ * @brief Boot stages timed from `setup()`, reported by `/debug/boot`
+ *
+ * Unlike `trace.hpp` always built: the stages run once and fit in a fixed table,
+ * so the cost of a slow boot can be read off any device
+ */
+
+#include <ArduinoJson.h>
+
+#include "trace.hpp"
+
+namespace boot {
+    /**
+     * @brief Start a stage
+     *
+     * @return The slot to pass to `end()`, `-1` once the table is full
+     */
+    int begin(const char *name);
+
+    void end(int slot);
+
+    /**
+     * @brief Record an instant, like the first frame or the IP address
+     */
+    void mark(const char *name);
+
+    /**
+     * @brief Stages in start order, times in ms since the boot
+     */
+    void to_json(JsonDocument &doc);
+
+    /// Times the stage between its construction and destruction
+    class Stage {
+        const int slot;
+
+      public:
+        explicit Stage(const char *name) : slot(begin(name)) {}
+        ~Stage() { end(this->slot); }
+
+        Stage(const Stage &)            = delete;
+        Stage &operator=(const Stage &) = delete;
+    };
+}  // namespace boot
+
+#define BOOT_CONCAT_(a, b) a##b
+#define BOOT_CONCAT(a, b)  BOOT_CONCAT_(a, b)
+/// Time the rest of the enclosing scope as a boot stage, also traced
+#define BOOT_STAGE(name)                                                                           \
+    TRACE_SCOPE(name);                                                                             \
+    const boot::Stage BOOT_CONCAT(boot_stage_, __LINE__)(name)
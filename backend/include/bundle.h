@@ -3,11 +3,22 @@
 #include <stddef.h>
 #include <stdint.h>
 
-inline size_t   index_full_html_gz_size = 0;
-inline uint8_t* index_full_html_gz      = nullptr;
+// In PSRAM when read from SPIFFS, in mapped flash when from the bundle partition
+// `*_crc` is the CRC-32 of the bundle, its ETag
+// `*_br` is the optional Brotli variant, served instead of `*_gz` to the clients accepting it
+inline size_t         index_full_html_gz_size = 0;
+inline const uint8_t* index_full_html_gz      = nullptr;
+inline uint32_t       index_full_html_gz_crc  = 0;
+inline size_t         index_full_html_br_size = 0;
+inline const uint8_t* index_full_html_br      = nullptr;
+inline uint32_t       index_full_html_br_crc  = 0;
 
-inline size_t   api_full_html_gz_size = 0;
-inline uint8_t* api_full_html_gz      = nullptr;
+inline size_t         api_full_html_gz_size = 0;
+inline const uint8_t* api_full_html_gz      = nullptr;
+inline uint32_t       api_full_html_gz_crc  = 0;
+inline size_t         api_full_html_br_size = 0;
+inline const uint8_t* api_full_html_br      = nullptr;
+inline uint32_t       api_full_html_br_crc  = 0;
 
 constexpr inline const uint8_t index_stub_html_gz[] = {
   0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xb4, 0x3a, 0x5d, 0x77, 0xdb, 0x36,
@@ -10,6 +10,7 @@
 #include <WiFi.h>
 
 #include "types/camera.hpp"
+#include "types/stream.hpp"
 
 // =============================
 // Version definitions
@@ -37,7 +38,24 @@ constexpr bool SERIAL_OUTPUT_DEBUG  = ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEB
 constexpr const char* SPIFFS_SETTINGS_PATH     = "/settings.jsonc";
 constexpr const char* SPIFFS_INDEX_BUNDLE_PATH = "/index.html.gz";
 constexpr const char* SPIFFS_API_BUNDLE_PATH   = "/api.html.gz";
-constexpr bool        SPIFFS_FORMAT_IF_FAILED  = true;
+/// Optional Brotli variants of the bundles
+constexpr const char* SPIFFS_INDEX_BR_BUNDLE_PATH = "/index.html.br";
+constexpr const char* SPIFFS_API_BR_BUNDLE_PATH   = "/api.html.br";
+constexpr bool        SPIFFS_FORMAT_IF_FAILED     = true;
+
+// =============================
+// Bundle partition settings
+// =============================
+
+/// Serve the bundles mapped from the partition, SPIFFS is the fallback for missing ones
+constexpr bool        BUNDLE_PARTITION_ENABLED = true;
+constexpr const char* BUNDLE_PARTITION_LABEL   = "bundle";
+/// Custom partition type, see `partitions.csv`
+constexpr uint8_t     BUNDLE_PARTITION_TYPE    = 0x40;
+constexpr const char* BUNDLE_INDEX_NAME        = "index.html.gz";
+constexpr const char* BUNDLE_API_NAME          = "api.html.gz";
+constexpr const char* BUNDLE_INDEX_BR_NAME     = "index.html.br";
+constexpr const char* BUNDLE_API_BR_NAME       = "api.html.br";
 
 // =============================
 // WiFi settings
@@ -75,6 +93,146 @@ constexpr const char* OTA_DEFAULT_PATH     = "/update";
 constexpr const char* OTA_DEFAULT_USERNAME = "";
 constexpr const char* OTA_DEFAULT_PASSWORD = "";
 
+// =============================
+// Stream settings
+// =============================
+
+/// Maximum number of simultaneous `/stream` viewers
+constexpr size_t STREAM_MAX_CLIENTS = 4;
+/// Frame slots shared by the capture loop and the viewers
+/// (each viewer holds at most one queued and one in-flight frame)
+constexpr size_t STREAM_MAX_FRAMES = 2 * STREAM_MAX_CLIENTS + 1;
+
+constexpr uint32_t    STREAM_TASK_STACK_SIZE = 4 * 1024;
+constexpr UBaseType_t STREAM_TASK_PRIORITY   = tskIDLE_PRIORITY + 6;
+
+/// Raw (non-JPEG) frames waiting for the encoder, the stale one is replaced
+constexpr size_t     STREAM_ENCODE_QUEUE_LEN  = 1;
+constexpr uint32_t   STREAM_ENCODE_STACK_SIZE = 8 * 1024;
+/// Capture and JPEG encoding run on different cores when there are two
+constexpr BaseType_t STREAM_CAPTURE_CORE = 0;
+constexpr BaseType_t STREAM_ENCODE_CORE  = portNUM_PROCESSORS > 1 ? 1 : 0;
+/// Pre-allocated JPEG output buffers for the encoder
+constexpr size_t STREAM_ENCODE_POOL_SIZE = 4;
+
+/// Cached single frames (`/capture`), one is filled while the others are served
+constexpr size_t   STREAM_SNAPSHOT_SLOTS   = 3;
+constexpr uint32_t STREAM_SNAPSHOT_TIMEOUT = 2000;
+
+/// Frames older than this (ms) are captured again by `/capture`
+constexpr uint32_t CAPTURE_DEFAULT_MAX_AGE = 1000;
+/// Quality used by `/capture` when the sensor doesn't output JPEG
+constexpr uint8_t CAPTURE_JPEG_QUALITY = 80;
+/// `/capture` requests waiting for the worker, more are refused with a 503
+constexpr size_t      CAPTURE_QUEUE_LEN         = 4;
+constexpr uint32_t    CAPTURE_WORKER_STACK_SIZE = 6 * 1024;
+constexpr UBaseType_t CAPTURE_WORKER_PRIORITY   = tskIDLE_PRIORITY + 5;
+
+/// Lowest frame rate a client can ask for, slower requests get this one
+constexpr float STREAM_MIN_FPS = 0.01f;
+
+/// How often the adaptive quality controller re-evaluates the link (ms)
+constexpr uint32_t STREAM_ADAPT_INTERVAL = 1000;
+
+/// Largest `/ws/stream` control message
+constexpr size_t STREAM_WS_CONTROL_SIZE = 128;
+
+// =============================
+// RTSP settings
+// =============================
+
+constexpr uint16_t RTSP_PORT         = 554;
+constexpr size_t   RTSP_MAX_SESSIONS = 1;
+/// UDP ports of session N are RTP: `RTSP_RTP_PORT + 2 * N`, RTCP: the next one
+constexpr uint16_t RTSP_RTP_PORT = 6970;
+/// Largest request (headers and body) a session buffers
+constexpr size_t RTSP_REQUEST_SIZE = 1024;
+/// Sessions without any request or RTCP for this long are closed (s)
+constexpr uint32_t RTSP_SESSION_TIMEOUT = 60;
+
+constexpr uint32_t    RTSP_TASK_STACK_SIZE = 6 * 1024;
+constexpr UBaseType_t RTSP_TASK_PRIORITY   = STREAM_TASK_PRIORITY;
+
+/// Largest RTP packet, fits an Ethernet/Wi-Fi MTU with the IP and UDP headers
+constexpr size_t RTP_MAX_PACKET_SIZE = 1400;
+
+// =============================
+// Multicast settings
+// =============================
+
+/// Largest multicast datagram, header included
+constexpr size_t MULTICAST_PACKET_SIZE = 1400;
+
+constexpr uint32_t    MULTICAST_TASK_STACK_SIZE = 4 * 1024;
+constexpr UBaseType_t MULTICAST_TASK_PRIORITY   = STREAM_TASK_PRIORITY;
+
+// =============================
+// App settings
+// =============================
+
+/// Of `/` and `/api`, revalidated with their ETag once stale, or on reload
+constexpr const char* BUNDLE_CACHE_CONTROL = "public, max-age=86400";
+/// Larger bundles are sent in chunks of this size by the sender tasks, smaller ones at once
+constexpr size_t BUNDLE_CHUNK_SIZE = 4 * 1024;
+/// Bundles sent at the same time, the app server sends the others itself while all are busy
+constexpr size_t      BUNDLE_SENDERS           = 2;
+constexpr uint32_t    BUNDLE_SENDER_STACK_SIZE = 4 * 1024;
+constexpr UBaseType_t BUNDLE_SENDER_PRIORITY   = tskIDLE_PRIORITY + 5;
+
+/// `/settings` and `/sensor` responses are serialized into a buffer of this size, sent as a chunk
+/// whenever it fills up
+constexpr size_t JSON_CHUNK_SIZE = 512;
+
+// =============================
+// Socket budget
+// =============================
+
+/// Each httpd keeps a listening and two control sockets for itself, OTA is served by the app one
+constexpr size_t HTTPD_SERVERS     = 2;
+constexpr size_t HTTPD_OWN_SOCKETS = 3;
+/// Viewers of the stream server, more wait for a free socket
+constexpr uint16_t STREAM_MAX_OPEN_SOCKETS = 2;
+/// The listener, and TCP, RTP and RTCP of each session, more connections aren't accepted
+constexpr size_t RTSP_SOCKETS      = 1 + 3 * RTSP_MAX_SESSIONS;
+constexpr size_t MULTICAST_SOCKETS = 1;
+/// Open sockets of the app server, the least recently used one is closed to accept another
+constexpr uint16_t APP_MAX_OPEN_SOCKETS = 3;
+
+static_assert(HTTPD_SERVERS * HTTPD_OWN_SOCKETS + STREAM_MAX_OPEN_SOCKETS + APP_MAX_OPEN_SOCKETS +
+                      RTSP_SOCKETS + MULTICAST_SOCKETS <=
+                  CONFIG_LWIP_MAX_SOCKETS,
+              "The servers need more sockets than CONFIG_LWIP_MAX_SOCKETS");
+
+// =============================
+// Metrics settings
+// =============================
+
+/// `/metrics` is rendered into a buffer of this size, sent as a chunk whenever it fills up
+constexpr size_t METRICS_BUFFER_SIZE = 1024;
+/// Tasks reported by `/metrics`, the others are left out
+constexpr size_t METRICS_MAX_TASKS = 32;
+
+// =============================
+// Trace settings
+// =============================
+
+/// Trace events kept in PSRAM when built with `TRACE_ENABLED`, a power of two
+constexpr size_t TRACE_BUFFER_EVENTS = 4096;
+/// `/debug/trace` is rendered into a buffer of this size, sent as a chunk whenever it fills up
+constexpr size_t TRACE_CHUNK_SIZE = 1024;
+
+// =============================
+// Boot settings
+// =============================
+
+/// Wait for the serial monitor before the first log, only when it is worth reading
+constexpr uint32_t BOOT_SERIAL_WAIT = SERIAL_OUTPUT_DEBUG ? 1000 : 0;
+/// Stages and marks kept for `/debug/boot`, later ones are dropped
+constexpr size_t BOOT_MAX_STAGES = 32;
+/// Boot tasks load the frontend while `setup()` brings the camera up, then blink the LED
+constexpr uint32_t    BOOT_TASK_STACK_SIZE = 6 * 1024;
+constexpr UBaseType_t BOOT_TASK_PRIORITY   = tskIDLE_PRIORITY + 1;
+
 // =============================
 // Settings
 // =============================
@@ -111,7 +269,9 @@ struct Settings_s {
         String username = OTA_DEFAULT_USERNAME;
         String password = OTA_DEFAULT_PASSWORD;
     } ota{};
-    CameraSettings_t camera{};
+    CameraSettings_t    camera{};
+    StreamSettings_t    stream{};
+    MulticastSettings_t multicast{};
 
     Settings_s()
         : magic((static_cast<uint64_t>(FIRMWARE_MAGIC) << 32U) |
@@ -119,15 +279,19 @@ struct Settings_s {
     explicit Settings_s(const uint64_t magic) : magic(magic){};
 
     Settings_s(const Settings_s& rhs) : magic(rhs.magic) {
-        this->wifi   = rhs.wifi;
-        this->ota    = rhs.ota;
-        this->camera = rhs.camera;
+        this->wifi      = rhs.wifi;
+        this->ota       = rhs.ota;
+        this->camera    = rhs.camera;
+        this->stream    = rhs.stream;
+        this->multicast = rhs.multicast;
     }
 
     Settings_s(Settings_s&& rhs) noexcept : magic(rhs.magic) {
-        this->wifi   = rhs.wifi;
-        this->ota    = rhs.ota;
-        this->camera = rhs.camera;
+        this->wifi      = rhs.wifi;
+        this->ota       = rhs.ota;
+        this->camera    = rhs.camera;
+        this->stream    = rhs.stream;
+        this->multicast = rhs.multicast;
     }
 
     Settings_s& operator=(const Settings_s& rhs) {
@@ -136,6 +300,8 @@ struct Settings_s {
             this->wifi                         = rhs.wifi;
             this->ota                          = rhs.ota;
             this->camera                       = rhs.camera;
+            this->stream                       = rhs.stream;
+            this->multicast                    = rhs.multicast;
         }
         return *this;
     }
@@ -146,6 +312,8 @@ struct Settings_s {
             this->wifi                         = std::move(rhs.wifi);
             this->ota                          = std::move(rhs.ota);
             this->camera                       = std::move(rhs.camera);
+            this->stream                       = std::move(rhs.stream);
+            this->multicast                    = std::move(rhs.multicast);
         }
         return *this;
     }
@@ -26,6 +26,7 @@ enum ErrorKind_u : uint8_t {
     ERR_APP_SERVER,
     ERR_STREAM_SERVER,
     ERR_OTA_SERVER,
+    ERR_RTSP_SERVER,
 };
 using ErrorKind_t = enum ErrorKind_u;
 
@@ -66,7 +67,8 @@ enum ErrorFrontend_u : uint8_t {
 
 enum ErrorApp_u : uint8_t {
     ERR_APP_START = 1,
-    ERR_APP_REG_URI
+    ERR_APP_REG_URI,
+    ERR_APP_TASK,
 };
 
 enum ErrorStream_u : uint8_t {
@@ -75,7 +77,10 @@ enum ErrorStream_u : uint8_t {
     ERR_STREAM_GET_FB,
     ERR_STREAM_ENCODE_JPEG,
     ERR_STREAM_SET_CT,
-    ERR_STREAM_SET_HDR
+    ERR_STREAM_SET_HDR,
+    ERR_STREAM_TASK,
+    ERR_STREAM_ASYNC,
+    ERR_STREAM_MULTICAST,
 };
 
 enum ErrorOTA_u : uint8_t {
@@ -85,6 +90,11 @@ enum ErrorOTA_u : uint8_t {
     ERR_OTA_HTTP_POST,
 };
 
+enum ErrorRTSP_u : uint8_t {
+    ERR_RTSP_START = 1,
+    ERR_RTSP_TASK,
+};
+
 /**
  * @brief Error code type
  *
@@ -117,7 +127,11 @@ typename std::conditional<
                             typename std::conditional<
                                 kind == ErrorKind_t::ERR_OTA_SERVER,
                                 ErrorOTA_u,
-                                uint8_t
+                                typename std::conditional<
+                                    kind == ErrorKind_t::ERR_RTSP_SERVER,
+                                    ErrorRTSP_u,
+                                    uint8_t
+                                >::type
                             >::type
                         >::type
                     >::type
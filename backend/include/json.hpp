@@ -58,6 +58,59 @@ namespace ArduinoJson {
         }
     };
 
+    template <>
+    struct Converter<StreamSettings_t> {
+        static bool toJson(const StreamSettings_t& src, JsonVariant dst) {
+#define X(dst, src, name) dst[#name] = src.name
+            X(dst, src, max_fps);
+            X(dst, src, adapt_mode);
+            X(dst, src, target_fps);
+            X(dst, src, target_bitrate);
+            X(dst, src, min_quality);
+            X(dst, src, max_quality);
+            X(dst, src, adapt_framesize);
+            X(dst, src, min_framesize);
+#undef X
+            return true;
+        }
+
+        static StreamSettings_t fromJson(JsonVariantConst src) {
+            StreamSettings_t stream_settings{};
+#define X(name) stream_settings.name = src[#name].template as<decltype(stream_settings.name)>()
+            X(max_fps);
+            X(adapt_mode);
+            X(target_fps);
+            X(target_bitrate);
+            X(min_quality);
+            X(max_quality);
+            X(adapt_framesize);
+            X(min_framesize);
+#undef X
+            return stream_settings;
+        }
+
+        static bool checkJson(JsonVariantConst src) {
+#define X(name) src[#name].template is<decltype(StreamSettings_t{}.name)>()
+            // clang-format off
+            return X(max_fps) &&
+                   X(adapt_mode) &&
+                   X(target_fps) &&
+                   X(target_bitrate) &&
+                   X(min_quality) &&
+                   X(max_quality) &&
+                   X(adapt_framesize) &&
+                   X(min_framesize) &&
+                   // `adapt_quality` clamps between them
+                   0 <= src["min_quality"].template as<int>() &&
+                   src["min_quality"].template as<int>() <= src["max_quality"].template as<int>() &&
+                   src["max_quality"].template as<int>() <= 63 &&
+                   0 <= src["min_framesize"].template as<int>() &&
+                   src["min_framesize"].template as<int>() < FRAMESIZE_INVALID;
+            // clang-format on
+#undef X
+        }
+    };
+
     template <>
     struct Converter<Settings_t> {
         static bool toJson(const Settings_t& src, JsonVariant dst) {
@@ -96,6 +149,16 @@ namespace ArduinoJson {
                 X(ota, password, src.ota);
             }
             X(dst, camera, src);
+            X(dst, stream, src);
+            JsonObject multicast = dst["multicast"].template to<JsonObject>();
+            {
+                X(multicast, enabled, src.multicast);
+                X(multicast, fec, src.multicast);
+                X(multicast, group, src.multicast);
+                X(multicast, port, src.multicast);
+                X(multicast, ttl, src.multicast);
+                X(multicast, max_fps, src.multicast);
+            }
 #undef X
             return true;
         }
@@ -148,6 +211,16 @@ namespace ArduinoJson {
                 X(settings.ota, password, ota);
             }
             X(settings, camera, src);
+            X(settings, stream, src);
+            JsonObjectConst multicast = src["multicast"];
+            {
+                X(settings.multicast, enabled, multicast);
+                X(settings.multicast, fec, multicast);
+                X_IP(settings.multicast, group, multicast);
+                X(settings.multicast, port, multicast);
+                X(settings.multicast, ttl, multicast);
+                X(settings.multicast, max_fps, multicast);
+            }
 #undef X_IP
 #undef X
             return settings;
@@ -175,7 +248,20 @@ namespace ArduinoJson {
                    src["ota"]["path"].template is<const char*>() &&
                    src["ota"]["username"].template is<const char*>() &&
                    src["ota"]["password"].template is<const char*>() &&
-                   src["camera"].template is<decltype(Settings_t{}.camera)>();
+                   src["camera"].template is<decltype(Settings_t{}.camera)>() &&
+                   src["stream"].template is<decltype(Settings_t{}.stream)>() &&
+                   0 <= src["camera"]["frame_size"].template as<int>() &&
+                   src["camera"]["frame_size"].template as<int>() < FRAMESIZE_INVALID &&
+                   // The largest frame size the controller may use is `camera.frame_size`
+                   framesize_pixels(src["stream"]["min_framesize"].template as<framesize_t>()) <=
+                       framesize_pixels(src["camera"]["frame_size"].template as<framesize_t>()) &&
+                   src["multicast"]["enabled"].template is<bool>() &&
+                   src["multicast"]["fec"].template is<bool>() &&
+                   src["multicast"]["group"].template is<const char*>() &&
+                   src["multicast"]["port"].template is<decltype(Settings_t{}.multicast.port)>() &&
+                   src["multicast"]["ttl"].template is<decltype(Settings_t{}.multicast.ttl)>() &&
+                   src["multicast"]["max_fps"]
+                       .template is<decltype(Settings_t{}.multicast.max_fps)>();
         }
     };
 }  // namespace ArduinoJson
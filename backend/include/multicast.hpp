@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+namespace multicast {
+    /// Datagram bytes sent since boot
+    uint64_t bytes_sent();
+
+    void start();
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+namespace rtsp {
+    /// RTP bytes sent since boot
+    uint64_t bytes_sent();
+
+    void start();
+}
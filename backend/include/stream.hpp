@@ -1,5 +1,111 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+
+#include <sys/time.h>
+
+#include <freertos/FreeRTOS.h>
+
+#include <esp_camera.h>
+
+#include "tools/histogram.hpp"
+
 namespace stream {
+    /// Copy of a captured frame, as delivered by the sensor
+    struct Snapshot_s {
+        uint8_t    *buf    = nullptr;
+        size_t      len    = 0;
+        size_t      width  = 0;
+        size_t      height = 0;
+        pixformat_t format = PIXFORMAT_JPEG;
+        timeval     timestamp{};
+    };
+    using Snapshot_t = struct Snapshot_s;
+
+    /**
+     * @brief Get a frame captured at most `max_age_us` ago
+     *
+     * @return Cached frame if it is fresh enough, otherwise the next captured one,
+     *         `nullptr` on timeout. Must be given back with `release`
+     *
+     * @note Concurrent callers share the same capture
+     */
+    const Snapshot_t *snapshot(int64_t max_age_us);
+    void              release(const Snapshot_t *snapshot);
+
+    /// JPEG frame shared by the stream clients, read-only
+    struct FrameInfo_s {
+        /// Owned by the camera driver, the encoder or the heap
+        uint8_t *buf = nullptr;
+        size_t   len = 0;
+        /// Capture timestamp
+        timeval timestamp{};
+        size_t  width  = 0;
+        size_t  height = 0;
+        /// Increments with every frame, gaps mean dropped frames
+        uint32_t seq = 0;
+        /// Sensor exposure (`aec_value`) and gain (`agc_gain`) when the frame was captured
+        uint16_t exposure = 0;
+        uint8_t  gain     = 0;
+    };
+    using FrameInfo_t = struct FrameInfo_s;
+
+    /// Index of a subscription, negative if there is none
+    using Subscriber_t = int;
+
+    /**
+     * @brief Receive the JPEG frames of the stream alongside the HTTP clients
+     *
+     * @param fps Frame rate limit, 0 means every frame, capped by `stream.max_fps`
+     *
+     * @return `-1` if every client slot is taken
+     *
+     * @note A subscriber still holding a frame skips the newer ones, like the HTTP clients
+     */
+    Subscriber_t       subscribe(float fps);
+    /**
+     * @brief Wait for the next frame
+     *
+     * @return `nullptr` on timeout, otherwise must be given back with `release`
+     */
+    const FrameInfo_t *next(Subscriber_t subscriber, TickType_t timeout);
+    void               release(Subscriber_t subscriber, const FrameInfo_t *frame);
+    /**
+     * @brief Stop the subscription, frames not given back yet are released
+     */
+    void               unsubscribe(Subscriber_t subscriber);
+
+    /// Up to 2^27 us (134 s) or bytes, within 12.5%
+    using StatsHistogram_t = Histogram<3, 27>;
+
+    /// Always-on statistics of the stream since boot, readable from any task
+    struct Stats_s {
+        /// Frames taken from the camera, including the ones only cached for `snapshot`
+        std::atomic<uint32_t> captured{0};
+        /// Frames sent to stream clients and subscribers
+        std::atomic<uint32_t> sent{0};
+        /// Frames skipped because the client was still busy with an older one
+        std::atomic<uint32_t> dropped{0};
+        /// JPEG bytes written by the stream server
+        std::atomic<uint64_t> bytes_sent{0};
+
+        /// Time between published frames in us
+        StatsHistogram_t frame_time{};
+        /// Published JPEG size in bytes
+        StatsHistogram_t frame_size{};
+        /// Time to encode a raw frame to JPEG in us
+        StatsHistogram_t encode_time{};
+        /// Time to write a frame to a client in us
+        StatsHistogram_t send_time{};
+        /// Capture to the first byte written to a client in us
+        StatsHistogram_t latency{};
+    };
+    using Stats_t = struct Stats_s;
+
+    const Stats_t &stats();
+
     void start();
-}
+}  // namespace stream
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+
+#include <string_view>
+
+/**
+ * @brief Case-insensitive comparison of ASCII tokens
+ */
+constexpr bool accept_token_equal(const std::string_view a, const std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        char x = a[i];
+        char y = b[i];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y) return false;
+    }
+    return true;
+}
+
+constexpr std::string_view accept_trim(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) str.remove_prefix(1);
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) str.remove_suffix(1);
+    return str;
+}
+
+/**
+ * @brief Whether an `Accept-Encoding` value (RFC 9110) allows `coding`
+ *
+ * The coding listed by name decides, otherwise `*` does. Either is refused with `q=0`
+ */
+constexpr bool accepts_encoding(const std::string_view header, const std::string_view coding) {
+    int named    = -1;
+    int wildcard = -1;
+    for (std::string_view rest = header; !rest.empty();) {
+        const size_t           comma = rest.find(',');
+        const std::string_view item  = rest.substr(0, comma);
+        rest                         = rest.substr(comma == rest.npos ? rest.size() : comma + 1);
+
+        const size_t           semicolon = item.find(';');
+        const std::string_view token     = accept_trim(item.substr(0, semicolon));
+        // Only `q=0`, `q=0.`, `q=0.000` refuse, any other weight accepts
+        bool accepted = true;
+        if (semicolon != item.npos) {
+            std::string_view param = accept_trim(item.substr(semicolon + 1));
+            if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                param.remove_prefix(2);
+                accepted = !(param.size() >= 1 && param[0] == '0');
+                for (size_t i = 1; !accepted && i < param.size(); i++) {
+                    if (param[i] != '.' && param[i] != '0') accepted = true;
+                }
+            }
+        }
+
+        if (accept_token_equal(token, coding)) named = accepted;
+        if (token == "*") wildcard = accepted;
+    }
+    if (named >= 0) return named;
+    return wildcard > 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+
+#include <esp_heap_caps.h>
+
+/**
+ * @brief Fixed set of equally sized buffers, allocated once and reused
+ *
+ * @tparam N Number of buffers
+ *
+ * @note `acquire` and `release` are lock-free and can be called from any task
+ */
+template <size_t N>
+class BufferPool {
+    std::array<uint8_t *, N>         buffers{};
+    std::array<std::atomic<bool>, N> used{};
+    size_t                           size = 0;
+
+  public:
+    /**
+     * @brief Allocate all the buffers
+     *
+     * @return `true` if every buffer was allocated
+     */
+    bool allocate(const size_t size, const uint32_t caps) {
+        for (auto &buffer : this->buffers) {
+            buffer = static_cast<uint8_t *>(heap_caps_malloc(size, caps));
+            if (!buffer) {
+                this->free();
+                return false;
+            }
+        }
+        this->size = size;
+        return true;
+    }
+
+    /**
+     * @brief Free all the buffers
+     *
+     * @note None of the buffers may be in use
+     */
+    void free() {
+        for (auto &buffer : this->buffers) {
+            heap_caps_free(buffer);
+            buffer = nullptr;
+        }
+        this->size = 0;
+    }
+
+    bool   allocated() const { return this->size > 0; }
+    size_t capacity() const { return this->size; }
+
+    /**
+     * @brief Take a free buffer
+     *
+     * @return Buffer of `capacity()` bytes, `nullptr` if all are in use
+     */
+    uint8_t *acquire() {
+        for (size_t i = 0; i < N; i++) {
+            if (this->buffers[i] && !this->used[i].exchange(true)) return this->buffers[i];
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Give the buffer back
+     *
+     * @return `false` if the buffer doesn't belong to the pool
+     */
+    bool release(const uint8_t *buffer) {
+        for (size_t i = 0; i < N; i++) {
+            if (buffer && this->buffers[i] == buffer) {
+                this->used[i] = false;
+                return true;
+            }
+        }
+        return false;
+    }
+};
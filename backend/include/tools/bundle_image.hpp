@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Layout of the bundle partition image, written by `make_bundle -p`
+ *
+ * A header followed by the gzipped files, all little-endian. The image is mapped
+ * from flash and the files are served in place, so nothing is copied at boot
+ */
+
+constexpr uint32_t BUNDLE_MAGIC       = 0x4C444E42;  // "BNDL"
+constexpr uint16_t BUNDLE_VERSION     = 1;
+constexpr size_t   BUNDLE_NAME_SIZE   = 24;
+constexpr size_t   BUNDLE_MAX_ENTRIES = 8;
+
+struct BundleEntry_s {
+    /// Null-terminated, like `index.html.gz`
+    char name[BUNDLE_NAME_SIZE];
+    /// From the start of the image
+    uint32_t offset;
+    uint32_t size;
+    /// CRC-32 (IEEE) of the file
+    uint32_t crc32;
+    uint32_t reserved;
+};
+using BundleEntry_t = struct BundleEntry_s;
+static_assert(sizeof(BundleEntry_t) == 40, "BundleEntry_t layout mismatch");
+
+struct BundleHeader_s {
+    uint32_t magic;
+    /// Bumped on any change of this layout
+    uint16_t version;
+    uint16_t count;
+    /// Of the whole image, header included
+    uint32_t      size;
+    uint32_t      reserved;
+    BundleEntry_t entries[BUNDLE_MAX_ENTRIES];
+};
+using BundleHeader_t = struct BundleHeader_s;
+static_assert(sizeof(BundleHeader_t) == 16 + 40 * BUNDLE_MAX_ENTRIES,
+              "BundleHeader_t layout mismatch");
+
+/**
+ * @brief Check `header` before the image is mapped
+ *
+ * @param partition_size Size of the partition holding the image
+ *
+ * @return Why the image can't be used, `nullptr` if it can
+ */
+inline const char *bundle_header_check(const BundleHeader_t &header, const size_t partition_size) {
+    // Erased flash reads as 0xFF
+    if (header.magic != BUNDLE_MAGIC) return "no bundle image";
+    if (header.version != BUNDLE_VERSION) return "unsupported bundle version";
+    if (header.count > BUNDLE_MAX_ENTRIES) return "too many entries";
+    if (header.size < sizeof(BundleHeader_t) || header.size > partition_size) {
+        return "image size out of the partition";
+    }
+
+    for (size_t i = 0; i < header.count; i++) {
+        const BundleEntry_t &entry = header.entries[i];
+        if (memchr(entry.name, '\0', BUNDLE_NAME_SIZE) == nullptr) return "unterminated name";
+        if (entry.offset < sizeof(BundleHeader_t) || entry.offset > header.size ||
+            entry.size > header.size - entry.offset) {
+            return "entry out of the image";
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Entry called `name`, in a header that passed `bundle_header_check`
+ *
+ * @return `nullptr` if there is none
+ */
+inline const BundleEntry_t *bundle_find(const BundleHeader_t &header, const char *name) {
+    for (size_t i = 0; i < header.count; i++) {
+        if (strncmp(header.entries[i].name, name, BUNDLE_NAME_SIZE) == 0) {
+            return &header.entries[i];
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <string_view>
+
+/**
+ * @brief Compile-time JSON tools, for the documents embedded in the firmware
+ *
+ * Meant for `static_assert` and `constexpr` variables, so malformed JSON fails
+ * the build and only the minified text ends up in flash
+ */
+
+/// Returned by the `json_skip_*` functions on malformed JSON
+static constexpr size_t JSON_ERROR = std::string_view::npos;
+/// Objects and arrays nested deeper are rejected
+static constexpr size_t JSON_MAX_DEPTH = 32;
+
+constexpr bool json_is_space(const char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+constexpr bool json_is_digit(const char c) {
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool json_is_hex(const char c) {
+    return json_is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+constexpr size_t json_skip_space(const std::string_view json, size_t i) {
+    while (i < json.size() && json_is_space(json[i])) i++;
+    return i;
+}
+
+/**
+ * @brief Skip the string starting at `i`
+ *
+ * @return Index after the closing quote, `JSON_ERROR` if malformed
+ */
+constexpr size_t json_skip_string(const std::string_view json, size_t i) {
+    if (i >= json.size() || json[i] != '"') return JSON_ERROR;
+    for (i++; i < json.size(); i++) {
+        const char c = json[i];
+        if (c == '"') return i + 1;
+        if (static_cast<uint8_t>(c) < 0x20) return JSON_ERROR;
+        if (c != '\\') continue;
+
+        if (++i >= json.size()) return JSON_ERROR;
+        switch (json[i]) {
+            case '"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+                break;
+            case 'u':
+                for (size_t digit = 0; digit < 4; digit++) {
+                    if (++i >= json.size() || !json_is_hex(json[i])) return JSON_ERROR;
+                }
+                break;
+            default:
+                return JSON_ERROR;
+        }
+    }
+    return JSON_ERROR;
+}
+
+/**
+ * @brief Skip the number starting at `i`
+ *
+ * @return Index after the number, `JSON_ERROR` if malformed
+ */
+constexpr size_t json_skip_number(const std::string_view json, size_t i) {
+    const auto digits = [&json](size_t i) {
+        const size_t start = i;
+        while (i < json.size() && json_is_digit(json[i])) i++;
+        return i > start ? i : JSON_ERROR;
+    };
+
+    if (i < json.size() && json[i] == '-') i++;
+    if (i < json.size() && json[i] == '0') {
+        i++;
+    } else if ((i = digits(i)) == JSON_ERROR) {
+        return JSON_ERROR;
+    }
+    if (i < json.size() && json[i] == '.') {
+        if ((i = digits(i + 1)) == JSON_ERROR) return JSON_ERROR;
+    }
+    if (i < json.size() && (json[i] == 'e' || json[i] == 'E')) {
+        i++;
+        if (i < json.size() && (json[i] == '+' || json[i] == '-')) i++;
+        if ((i = digits(i)) == JSON_ERROR) return JSON_ERROR;
+    }
+    return i;
+}
+
+/**
+ * @brief Skip the value starting at `i`, without the whitespace around it
+ *
+ * @return Index after the value, `JSON_ERROR` if malformed
+ */
+constexpr size_t json_skip_value(const std::string_view json, size_t i, const size_t depth = 0) {
+    if (i >= json.size()) return JSON_ERROR;
+
+    const char c = json[i];
+    if (c == '"') return json_skip_string(json, i);
+    if (c == '-' || json_is_digit(c)) return json_skip_number(json, i);
+    for (const std::string_view literal : {"true", "false", "null"}) {
+        if (json.substr(i, literal.size()) == literal) return i + literal.size();
+    }
+    if (c != '{' && c != '[') return JSON_ERROR;
+    if (depth >= JSON_MAX_DEPTH) return JSON_ERROR;
+
+    const bool object = c == '{';
+    const char close  = object ? '}' : ']';
+    i                 = json_skip_space(json, i + 1);
+    if (i < json.size() && json[i] == close) return i + 1;
+    while (true) {
+        if (object) {
+            i = json_skip_string(json, i);
+            if (i == JSON_ERROR) return JSON_ERROR;
+            i = json_skip_space(json, i);
+            if (i >= json.size() || json[i] != ':') return JSON_ERROR;
+            i = json_skip_space(json, i + 1);
+        }
+        i = json_skip_value(json, i, depth + 1);
+        if (i == JSON_ERROR) return JSON_ERROR;
+        i = json_skip_space(json, i);
+        if (i >= json.size()) return JSON_ERROR;
+        if (json[i] == close) return i + 1;
+        if (json[i] != ',') return JSON_ERROR;
+        i = json_skip_space(json, i + 1);
+    }
+}
+
+/**
+ * @brief Whether `json` is exactly one valid JSON value, whitespace around it allowed
+ */
+constexpr bool json_valid(const std::string_view json) {
+    const size_t end = json_skip_value(json, json_skip_space(json, 0));
+    return end != JSON_ERROR && json_skip_space(json, end) == json.size();
+}
+
+/**
+ * @brief Length of `json` without the whitespace outside of strings
+ */
+constexpr size_t json_minified_size(const std::string_view json) {
+    size_t size      = 0;
+    bool   in_string = false;
+    for (size_t i = 0; i < json.size(); i++) {
+        const char c = json[i];
+        if (in_string) {
+            size++;
+            if (c == '\\') {
+                size++;
+                i++;
+            } else if (c == '"') {
+                in_string = false;
+            }
+        } else if (!json_is_space(c)) {
+            size++;
+            in_string = c == '"';
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief `json` without the whitespace outside of strings, null-terminated
+ *
+ * @tparam N `json_minified_size(json)`
+ */
+template <size_t N>
+constexpr std::array<char, N + 1> json_minify(const std::string_view json) {
+    std::array<char, N + 1> out{};
+    size_t                  len       = 0;
+    bool                    in_string = false;
+    for (size_t i = 0; i < json.size() && len < N; i++) {
+        const char c = json[i];
+        if (in_string) {
+            out[len++] = c;
+            if (c == '\\' && len < N) {
+                out[len++] = json[++i];
+            } else if (c == '"') {
+                in_string = false;
+            }
+        } else if (!json_is_space(c)) {
+            out[len++] = c;
+            in_string  = c == '"';
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Find a value by its JSON Pointer (RFC 6901), like `"/properties/framesize"`
+ *
+ * @note Object keys are compared as written, without `~` or `\` escapes
+ *
+ * @return The value within `json`, empty if there is none or `json` is malformed
+ */
+constexpr std::string_view json_pointer(const std::string_view json,
+                                        const std::string_view pointer) {
+    size_t           i    = json_skip_space(json, 0);
+    std::string_view rest = pointer;
+    while (!rest.empty()) {
+        if (rest[0] != '/' || i >= json.size()) return {};
+        const size_t           next  = rest.find('/', 1);
+        const std::string_view token = rest.substr(1, next == rest.npos ? rest.npos : next - 1);
+        rest                         = next == rest.npos ? std::string_view{} : rest.substr(next);
+
+        const bool object = json[i] == '{';
+        if (!object && json[i] != '[') return {};
+        // Array index, the token is made of digits
+        size_t index = 0;
+        for (const char c : token) {
+            if (object) break;
+            if (!json_is_digit(c)) return {};
+            index = index * 10 + (c - '0');
+        }
+
+        bool found = false;
+        i          = json_skip_space(json, i + 1);
+        for (size_t member = 0; !found && i < json.size() && json[i] != '}' && json[i] != ']';
+             member++) {
+            if (object) {
+                const size_t key_end = json_skip_string(json, i);
+                if (key_end == JSON_ERROR) return {};
+                found = json.substr(i + 1, key_end - i - 2) == token;
+                i     = json_skip_space(json, key_end);
+                if (i >= json.size() || json[i] != ':') return {};
+                i = json_skip_space(json, i + 1);
+            } else {
+                found = member == index;
+            }
+            if (found) break;
+
+            i = json_skip_value(json, i);
+            if (i == JSON_ERROR) return {};
+            i = json_skip_space(json, i);
+            if (i < json.size() && json[i] == ',') i = json_skip_space(json, i + 1);
+        }
+        if (!found) return {};
+    }
+
+    const size_t end = json_skip_value(json, i);
+    if (end == JSON_ERROR) return {};
+    return json.substr(i, end - i);
+}
+
+/**
+ * @brief Text built at compile time, in two passes: `JsonText<0>` only measures it
+ *
+ * @code
+ * template <size_t N>
+ * constexpr JsonText<N> build() { JsonText<N> out; out.append("..."); return out; }
+ * constexpr auto text = build<build<0>().size()>();
+ * @endcode
+ */
+template <size_t N>
+class JsonText {
+    std::array<char, N + 1> text{};
+    size_t                  len = 0;
+
+  public:
+    constexpr void append(const std::string_view str) {
+        for (const char c : str) {
+            if (this->len < N) this->text[this->len] = c;
+            this->len++;
+        }
+    }
+
+    constexpr void append(const int64_t value) {
+        char     digits[20]{};
+        size_t   count     = 0;
+        uint64_t magnitude = value < 0 ? -static_cast<uint64_t>(value) : value;
+        do {
+            digits[count++]  = '0' + magnitude % 10;
+            magnitude       /= 10;
+        } while (magnitude);
+
+        if (value < 0) this->append("-");
+        while (count) this->append(std::string_view(&digits[--count], 1));
+    }
+
+    constexpr size_t size() const { return this->len; }
+    /// Null-terminated
+    constexpr const char *data() const { return this->text.data(); }
+    constexpr std::string_view view() const { return {this->text.data(), this->len}; }
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
+#include <rom/miniz.h>
+
+/// Member header without a name, time or extra fields, OS unknown
+static constexpr uint8_t GZIP_HEADER[]     = {0x1f, 0x8b, 0x08, 0x00, 0, 0, 0, 0, 0x00, 0xff};
+static constexpr size_t  GZIP_TRAILER_SIZE = 8;
+
+/**
+ * @brief Compress `src` into a single gzip member, with the deflater in ROM
+ *
+ * @param caps Where the output and the ~160kB compressor state are allocated
+ *
+ * @return Buffer of `*out_len` bytes to be freed with `heap_caps_free`,
+ *         `nullptr` if out of memory or the output would be bigger than `src`
+ */
+inline uint8_t *gzip_compress(const void *src, size_t len, size_t *out_len, const uint32_t caps) {
+    const size_t capacity = sizeof(GZIP_HEADER) + len + GZIP_TRAILER_SIZE;
+    auto        *out      = static_cast<uint8_t *>(heap_caps_malloc(capacity, caps));
+    auto        *compressor =
+        static_cast<tdefl_compressor *>(heap_caps_malloc(sizeof(tdefl_compressor), caps));
+    if (!out || !compressor) {
+        heap_caps_free(out);
+        heap_caps_free(compressor);
+        return nullptr;
+    }
+
+    size_t       in_size  = len;
+    size_t       deflated = capacity - sizeof(GZIP_HEADER) - GZIP_TRAILER_SIZE;
+    tdefl_status status   = tdefl_init(compressor, nullptr, nullptr, TDEFL_DEFAULT_MAX_PROBES);
+    if (status == TDEFL_STATUS_OKAY) {
+        status = tdefl_compress(compressor,
+                                src,
+                                &in_size,
+                                out + sizeof(GZIP_HEADER),
+                                &deflated,
+                                TDEFL_FINISH);
+    }
+    heap_caps_free(compressor);
+    if (status != TDEFL_STATUS_DONE) {
+        heap_caps_free(out);
+        return nullptr;
+    }
+
+    const uint32_t crc     = esp_rom_crc32_le(0, static_cast<const uint8_t *>(src), len);
+    const uint32_t size    = len;
+    uint8_t       *trailer = out + sizeof(GZIP_HEADER) + deflated;
+    memcpy(out, GZIP_HEADER, sizeof(GZIP_HEADER));
+    for (size_t i = 0; i < 4; i++) {
+        trailer[i]     = crc >> (8 * i);
+        trailer[4 + i] = size >> (8 * i);
+    }
+
+    *out_len = sizeof(GZIP_HEADER) + deflated + GZIP_TRAILER_SIZE;
+    return out;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+
+/**
+ * @brief Fixed-memory histogram with logarithmic buckets, for percentiles
+ *
+ * Values below `2^SubBits` get a bucket each, above that every power of two is
+ * split into `2^SubBits` buckets, so a bucket is at most `1 / 2^SubBits` of its
+ * values wide (12.5% by default) whatever their magnitude
+ *
+ * @tparam SubBits Sub-buckets per power of two, as a power of two
+ * @tparam MaxBits Values from `2^MaxBits` on land in the last bucket
+ *
+ * @note `record` and the readers are lock-free and can be called from any task.
+ *       Readers see every bucket as it was at some point of the read, not all
+ *       of them at once
+ */
+template <uint8_t SubBits = 3, uint8_t MaxBits = 32>
+class Histogram {
+    static_assert(SubBits > 0 && SubBits < MaxBits && MaxBits <= 32);
+
+    static constexpr uint32_t SUB_COUNT = 1U << SubBits;
+
+  public:
+    static constexpr size_t BUCKETS = (MaxBits - SubBits + 1) * SUB_COUNT;
+
+    static constexpr size_t bucket_of(const uint32_t value) {
+        if (value < SUB_COUNT) return value;
+        const uint8_t msb = 31 - __builtin_clz(value);
+        if (msb >= MaxBits) return BUCKETS - 1;
+        const uint8_t shift = msb - SubBits;
+        return (shift + 1) * SUB_COUNT + ((value >> shift) - SUB_COUNT);
+    }
+
+    /// Smallest value of the bucket
+    static constexpr uint32_t bucket_lower(const size_t bucket) {
+        if (bucket < SUB_COUNT) return bucket;
+        const uint8_t shift = bucket / SUB_COUNT - 1;
+        return (SUB_COUNT + bucket % SUB_COUNT) << shift;
+    }
+
+    /// Largest value of the bucket, `UINT32_MAX` for the last one
+    static constexpr uint32_t bucket_upper(const size_t bucket) {
+        if (bucket + 1 >= BUCKETS) return UINT32_MAX;
+        return bucket_lower(bucket + 1) - 1;
+    }
+
+    void record(const uint32_t value) {
+        this->buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        this->total.fetch_add(value, std::memory_order_relaxed);
+        this->samples.fetch_add(1, std::memory_order_release);
+
+        uint32_t min = this->lowest.load(std::memory_order_relaxed);
+        while (value < min && !this->lowest.compare_exchange_weak(min, value)) {}
+        uint32_t max = this->highest.load(std::memory_order_relaxed);
+        while (value > max && !this->highest.compare_exchange_weak(max, value)) {}
+    }
+
+    uint32_t count() const { return this->samples.load(std::memory_order_acquire); }
+    /// Sum of all the values, for the mean
+    uint64_t sum() const { return this->total.load(std::memory_order_relaxed); }
+    /// 0 if nothing was recorded
+    uint32_t min() const { return this->count() ? this->lowest.load() : 0; }
+    uint32_t max() const { return this->highest.load(); }
+
+    uint32_t bucket(const size_t bucket) const {
+        return this->buckets[bucket].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Value below which `p` percent of the samples are
+     *
+     * @return Middle of the bucket holding the sample, within the recorded range,
+     *         0 if nothing was recorded
+     */
+    uint32_t percentile(const float p) const {
+        uint64_t samples = 0;
+        for (size_t i = 0; i < BUCKETS; i++) samples += this->bucket(i);
+        if (samples == 0) return 0;
+
+        uint64_t rank = static_cast<uint64_t>(samples * (p / 100) + 0.5f);
+        if (rank < 1) rank = 1;
+        if (rank >= samples) return this->max();
+
+        // Buckets only grow, a sample recorded meanwhile can't make the walk fall short
+        uint64_t seen = 0;
+        size_t   i    = 0;
+        for (; i + 1 < BUCKETS; i++) {
+            seen += this->bucket(i);
+            if (seen >= rank) break;
+        }
+        const uint32_t lower = bucket_lower(i);
+        const uint32_t upper = i + 1 < BUCKETS ? bucket_upper(i) : this->max();
+        const uint32_t mid   = lower + (upper - lower) / 2;
+        if (mid < this->min()) return this->min();
+        if (mid > this->max()) return this->max();
+        return mid;
+    }
+
+    /**
+     * @brief Forget every sample
+     *
+     * @note Samples recorded meanwhile may be partly kept
+     */
+    void clear() {
+        for (auto &bucket : this->buckets) bucket.store(0, std::memory_order_relaxed);
+        this->total.store(0, std::memory_order_relaxed);
+        this->lowest.store(UINT32_MAX, std::memory_order_relaxed);
+        this->highest.store(0, std::memory_order_relaxed);
+        this->samples.store(0, std::memory_order_release);
+    }
+
+  private:
+    std::array<std::atomic<uint32_t>, BUCKETS> buckets{};
+    std::atomic<uint32_t>                      samples{0};
+    /// 64-bit atomics take a short critical section on Xtensa, the rest is lock-free
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint32_t> lowest{UINT32_MAX};
+    std::atomic<uint32_t> highest{0};
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+
+#include <esp_http_server.h>
+
+/**
+ * @brief Writer sending a response as chunks of a fixed buffer
+ *
+ * Fits `serializeJson` as a custom writer, so a document of any size goes out
+ * without being serialized into a `String` first
+ *
+ * @note The first failed chunk stops the writer, `end` returns its error
+ */
+class HttpChunkWriter {
+    httpd_req_t *req;
+    char        *buf;
+    size_t       size;
+    size_t       len = 0;
+    esp_err_t    err = ESP_OK;
+
+  public:
+    /**
+     * @param buf Must outlive the writer, reused for every chunk
+     */
+    HttpChunkWriter(httpd_req_t *req, char *buf, const size_t size)
+        : req(req), buf(buf), size(size) {}
+
+    size_t write(const uint8_t c) { return this->write(&c, 1); }
+
+    size_t write(const uint8_t *data, size_t n) {
+        const size_t written = n;
+        while (n > 0 && this->err == ESP_OK) {
+            const size_t part = std::min(n, this->size - this->len);
+            memcpy(this->buf + this->len, data, part);
+            this->len += part;
+            data      += part;
+            n         -= part;
+            if (this->len == this->size) this->flush();
+        }
+        return written;
+    }
+
+    /**
+     * @brief Send what is buffered as a chunk
+     */
+    void flush() {
+        if (this->err == ESP_OK && this->len > 0) {
+            this->err = httpd_resp_send_chunk(this->req, this->buf, this->len);
+        }
+        this->len = 0;
+    }
+
+    /**
+     * @brief Flush and terminate the response
+     */
+    esp_err_t end() {
+        this->flush();
+        if (this->err != ESP_OK) return this->err;
+        return httpd_resp_send_chunk(this->req, nullptr, 0);
+    }
+};
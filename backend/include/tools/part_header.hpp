@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Header of every multipart part, `#` runs are the fields
+ *
+ * @note Fields are right-aligned and padded with spaces, which HTTP allows in
+ *       front of a header value, so every header has the same length
+ */
+constexpr char PART_HEADER_TEMPLATE[] = "Content-Type: image/jpeg\r\n"
+                                        "Content-Length: ##########\r\n"
+                                        "X-Timestamp: ##########.######\r\n"
+                                        "X-Framerate: #####.#\r\n"
+                                        "X-Average-Framerate: #####.#\r\n"
+                                        "X-Sequence: ##########\r\n"
+                                        "X-Latency: ##########\r\n"
+                                        "X-Exposure: #####\r\n"
+                                        "X-Gain: ###\r\n"
+                                        "\r\n";
+constexpr size_t PART_HEADER_SIZE = sizeof(PART_HEADER_TEMPLATE) - 1;
+
+/// Fields of `PART_HEADER_TEMPLATE`, in order
+enum PartHeaderField_e : uint8_t {
+    PART_CONTENT_LENGTH,
+    PART_TIMESTAMP_SEC,
+    PART_TIMESTAMP_USEC,
+    PART_FRAMERATE,
+    PART_FRAMERATE_TENTHS,
+    PART_AVG_FRAMERATE,
+    PART_AVG_FRAMERATE_TENTHS,
+    PART_SEQUENCE,
+    PART_LATENCY,
+    PART_EXPOSURE,
+    PART_GAIN,
+    PART_FIELD_COUNT,
+};
+using PartHeaderField_t = enum PartHeaderField_e;
+
+/// Position of a `#` run in the template
+struct PartHeaderSpan_s {
+    size_t offset = 0;
+    size_t width  = 0;
+};
+using PartHeaderSpan_t = struct PartHeaderSpan_s;
+
+/// Values of the part header
+struct PartHeader_s {
+    size_t   content_length = 0;
+    int64_t  timestamp_sec  = 0;
+    uint32_t timestamp_usec = 0;
+    /// Time since the previous frame, sets the frame rates
+    int64_t frame_time_ms     = 0;
+    int64_t avg_frame_time_ms = 0;
+    /// Frame sequence number, gaps mean dropped frames
+    uint32_t seq = 0;
+    /// Capture to first byte sent
+    int64_t  latency_us = 0;
+    uint16_t exposure   = 0;
+    uint8_t  gain       = 0;
+};
+using PartHeader_t = struct PartHeader_s;
+
+/**
+ * @brief Find the `index`th `#` run of the template
+ */
+constexpr PartHeaderSpan_t part_header_span(const size_t index) {
+    size_t found = 0;
+    for (size_t i = 0; i < PART_HEADER_SIZE; i++) {
+        if (PART_HEADER_TEMPLATE[i] != '#') continue;
+        size_t end = i;
+        while (end < PART_HEADER_SIZE && PART_HEADER_TEMPLATE[end] == '#') end++;
+        if (found++ == index) return {i, end - i};
+        i = end;
+    }
+    return {};
+}
+
+/**
+ * @brief Write `value` in decimal into the `width` characters ending at `end`
+ *
+ * @param pad Fills the characters left of the digits
+ *
+ * @note Values too wide for the field are clamped to all nines
+ */
+inline void part_header_put_uint(char *end, size_t width, uint64_t value, const char pad) {
+    uint64_t max = 1;
+    for (size_t i = 0; i < width; i++) max *= 10;
+    if (value >= max) value = max - 1;
+
+    do {
+        *--end  = '0' + value % 10;
+        value  /= 10;
+        width--;
+    } while (value && width);
+    while (width--) *--end = pad;
+}
+
+/**
+ * @brief Fill the field of the template with `value`
+ */
+inline void part_header_put(char *header, const PartHeaderField_t field, const uint64_t value) {
+    constexpr PartHeaderSpan_t spans[] = {
+      part_header_span(PART_CONTENT_LENGTH),
+      part_header_span(PART_TIMESTAMP_SEC),
+      part_header_span(PART_TIMESTAMP_USEC),
+      part_header_span(PART_FRAMERATE),
+      part_header_span(PART_FRAMERATE_TENTHS),
+      part_header_span(PART_AVG_FRAMERATE),
+      part_header_span(PART_AVG_FRAMERATE_TENTHS),
+      part_header_span(PART_SEQUENCE),
+      part_header_span(PART_LATENCY),
+      part_header_span(PART_EXPOSURE),
+      part_header_span(PART_GAIN),
+    };
+    static_assert(sizeof(spans) / sizeof(spans[0]) == PART_FIELD_COUNT);
+    static_assert(part_header_span(PART_FIELD_COUNT).width == 0, "Unnamed field in the template");
+
+    const PartHeaderSpan_t span = spans[field];
+    // Fractional parts keep their leading zeros
+    const char pad = field == PART_TIMESTAMP_USEC || field == PART_FRAMERATE_TENTHS ||
+                             field == PART_AVG_FRAMERATE_TENTHS
+                         ? '0'
+                         : ' ';
+    part_header_put_uint(header + span.offset + span.width, span.width, value, pad);
+}
+
+/**
+ * @brief Frame rate in tenths of fps, rounded, integer only
+ *
+ * @return 0 if `frame_time` is not positive
+ */
+constexpr uint32_t part_header_fps_x10(const int64_t frame_time_ms) {
+    return frame_time_ms > 0 ? (10000 + frame_time_ms / 2) / frame_time_ms : 0;
+}
+
+/**
+ * @brief Build the part header without `snprintf` or floats
+ *
+ * @param dst At least `PART_HEADER_SIZE` bytes
+ *
+ * @return `PART_HEADER_SIZE`
+ */
+inline size_t part_header_build(char *dst, const PartHeader_t &header) {
+    const uint32_t fps     = part_header_fps_x10(header.frame_time_ms);
+    const uint32_t avg_fps = part_header_fps_x10(header.avg_frame_time_ms);
+
+    memcpy(dst, PART_HEADER_TEMPLATE, PART_HEADER_SIZE);
+    part_header_put(dst, PART_CONTENT_LENGTH, header.content_length);
+    part_header_put(dst, PART_TIMESTAMP_SEC, header.timestamp_sec > 0 ? header.timestamp_sec : 0);
+    part_header_put(dst, PART_TIMESTAMP_USEC, header.timestamp_usec);
+    part_header_put(dst, PART_FRAMERATE, fps / 10);
+    part_header_put(dst, PART_FRAMERATE_TENTHS, fps % 10);
+    part_header_put(dst, PART_AVG_FRAMERATE, avg_fps / 10);
+    part_header_put(dst, PART_AVG_FRAMERATE_TENTHS, avg_fps % 10);
+    part_header_put(dst, PART_SEQUENCE, header.seq);
+    part_header_put(dst, PART_LATENCY, header.latency_us > 0 ? header.latency_us : 0);
+    part_header_put(dst, PART_EXPOSURE, header.exposure);
+    part_header_put(dst, PART_GAIN, header.gain);
+    return PART_HEADER_SIZE;
+}
+
+/**
+ * @brief Write `value` in hexadecimal, like `"%zx"`
+ *
+ * @param dst At least `2 * sizeof(size_t)` bytes
+ *
+ * @return Number of digits written
+ */
+inline size_t part_header_put_hex(char *dst, size_t value) {
+    static constexpr char digits[] = "0123456789abcdef";
+
+    size_t len = 0;
+    for (size_t rest = value; len == 0 || rest; rest >>= 4) len++;
+    for (size_t i = len; i > 0; i--, value >>= 4) dst[i - 1] = digits[value & 0xF];
+    return len;
+}
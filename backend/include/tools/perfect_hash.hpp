@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <string_view>
+
+/**
+ * @brief Seeded FNV-1a, with a final mix so the low bits depend on every byte
+ */
+constexpr uint32_t perfect_hash_fnv(const std::string_view key, const uint32_t seed) {
+    uint32_t hash = 2166136261U ^ seed;
+    for (const char c : key) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619U;
+    }
+    return hash ^ (hash >> 15);
+}
+
+/**
+ * @brief Round up to a power of two, for `Slots`
+ */
+constexpr size_t perfect_hash_slots(const size_t n) {
+    size_t slots = 1;
+    while (slots < n) slots <<= 1;
+    return slots;
+}
+
+/**
+ * @brief Collision-free hash table over a fixed set of keys, built at compile time
+ *
+ * The seed is searched until every key lands in its own slot, so a lookup is one
+ * hash and one comparison
+ *
+ * @tparam N     Number of keys, at most 255
+ * @tparam Slots Power of two, a sparser table needs fewer seeds to be tried
+ */
+template <size_t N, size_t Slots = perfect_hash_slots(4 * N)>
+class PerfectHash {
+    static_assert(N > 0 && N < UINT8_MAX);
+    static_assert(Slots >= N && (Slots & (Slots - 1)) == 0, "Slots must be a power of two");
+
+    static constexpr uint8_t  EMPTY     = UINT8_MAX;
+    static constexpr uint32_t MAX_SEEDS = 10000;
+
+    std::array<std::string_view, N> keys{};
+    std::array<uint8_t, Slots>      slots{};
+    uint32_t                        seed = 0;
+
+    constexpr bool try_seed(const uint32_t seed) {
+        for (auto &slot : this->slots) slot = EMPTY;
+        for (size_t i = 0; i < N; i++) {
+            uint8_t &slot = this->slots[perfect_hash_fnv(this->keys[i], seed) & (Slots - 1)];
+            if (slot != EMPTY) return false;
+            slot = i;
+        }
+        return true;
+    }
+
+  public:
+    /**
+     * @note Check `valid()`, it is `false` for duplicated keys or if no seed was found
+     */
+    constexpr explicit PerfectHash(const std::array<std::string_view, N> &keys) : keys(keys) {
+        for (size_t i = 0; i < N; i++) {
+            for (size_t j = i + 1; j < N; j++) {
+                if (keys[i] == keys[j]) return;
+            }
+        }
+        for (uint32_t seed = 1; seed < MAX_SEEDS; seed++) {
+            if (this->try_seed(seed)) {
+                this->seed = seed;
+                return;
+            }
+        }
+    }
+
+    constexpr bool valid() const { return this->seed != 0; }
+
+    /**
+     * @brief Index of `key` in the keys
+     *
+     * @return -1 if it isn't one of them
+     */
+    constexpr int find(const std::string_view key) const {
+        const uint8_t slot = this->slots[perfect_hash_fnv(key, this->seed) & (Slots - 1)];
+        if (slot == EMPTY || this->keys[slot] != key) return -1;
+        return slot;
+    }
+};
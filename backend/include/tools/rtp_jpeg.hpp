@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/// RTP payload type of JPEG, see RFC 3551
+constexpr uint8_t RTP_JPEG_PAYLOAD_TYPE = 26;
+/// RTP clock rate of video payloads
+constexpr uint32_t RTP_JPEG_CLOCK_RATE = 90000;
+
+constexpr size_t RTP_HEADER_SIZE      = 12;
+constexpr size_t RTP_JPEG_HEADER_SIZE = 8;
+constexpr size_t RTP_JPEG_DRI_SIZE    = 4;
+constexpr size_t RTP_JPEG_QHDR_SIZE   = 4;
+constexpr size_t RTP_JPEG_QTABLE_SIZE = 64;
+/// Largest header in front of the scan data, on the first packet of a frame
+constexpr size_t RTP_JPEG_MAX_HEADERS = RTP_HEADER_SIZE + RTP_JPEG_HEADER_SIZE +
+                                        RTP_JPEG_DRI_SIZE + RTP_JPEG_QHDR_SIZE +
+                                        2 * RTP_JPEG_QTABLE_SIZE;
+
+/**
+ * @brief Baseline JPEG split into what RFC 2435 sends
+ *
+ * @note The Huffman tables aren't sent, the receiver uses the standard ones
+ *       that both the sensor and `frame2jpg` encode with
+ */
+struct RtpJpegFrame_s {
+    /// 0 for 4:2:2, 1 for 4:2:0, plus 64 if restart markers are used
+    uint8_t  type             = 0;
+    uint16_t width            = 0;
+    uint16_t height           = 0;
+    uint16_t restart_interval = 0;
+    /// Luma and chroma quantization tables, 8-bit precision
+    const uint8_t *qtables[2] = {};
+    /// Entropy-coded data, without EOI
+    const uint8_t *scan     = nullptr;
+    size_t         scan_len = 0;
+};
+using RtpJpegFrame_t = struct RtpJpegFrame_s;
+
+/**
+ * @brief Find the parts of the JPEG needed by `rtp_jpeg_packetize`
+ *
+ * @return `false` if the JPEG is not a 4:2:2 or 4:2:0 baseline one with 8-bit
+ *         quantization tables, up to 2040x2040
+ */
+inline bool rtp_jpeg_parse(const uint8_t *jpeg, const size_t len, RtpJpegFrame_t &frame) {
+    static constexpr uint8_t SOI  = 0xD8;
+    static constexpr uint8_t EOI  = 0xD9;
+    static constexpr uint8_t SOF0 = 0xC0;
+    static constexpr uint8_t DQT  = 0xDB;
+    static constexpr uint8_t DRI  = 0xDD;
+    static constexpr uint8_t SOS  = 0xDA;
+
+    const uint8_t *tables[4] = {};
+    uint8_t        table_ids[2]{};
+    bool           has_sof = false;
+
+    if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != SOI) return false;
+
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (jpeg[pos] != 0xFF) return false;
+        const uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {
+            // Fill byte
+            pos++;
+            continue;
+        }
+        const size_t   segment_len = jpeg[pos + 2] << 8 | jpeg[pos + 3];
+        const uint8_t *segment     = jpeg + pos + 4;
+        if (segment_len < 2 || pos + 2 + segment_len > len) return false;
+        const size_t data_len = segment_len - 2;
+
+        switch (marker) {
+            case DQT:
+                for (size_t i = 0; i + 1 + RTP_JPEG_QTABLE_SIZE <= data_len;
+                     i += 1 + RTP_JPEG_QTABLE_SIZE) {
+                    // 16-bit tables can't be sent with Q = 255 here
+                    if (segment[i] >> 4 != 0) return false;
+                    tables[segment[i] & 0x03] = segment + i + 1;
+                }
+                break;
+            case SOF0: {
+                if (data_len < 6 + 3 * 3 || segment[0] != 8 || segment[5] != 3) return false;
+                frame.height              = segment[1] << 8 | segment[2];
+                frame.width               = segment[3] << 8 | segment[4];
+                const uint8_t luma        = segment[6 + 1];
+                const uint8_t chroma_blue = segment[6 + 3 + 1];
+                const uint8_t chroma_red  = segment[6 + 6 + 1];
+                if (chroma_blue != 0x11 || chroma_red != 0x11) return false;
+                if (luma == 0x21) {
+                    frame.type = 0;
+                } else if (luma == 0x22) {
+                    frame.type = 1;
+                } else {
+                    return false;
+                }
+                table_ids[0] = segment[6 + 2] & 0x03;
+                table_ids[1] = segment[6 + 3 + 2] & 0x03;
+                has_sof      = true;
+                break;
+            }
+            case DRI:
+                if (data_len < 2) return false;
+                frame.restart_interval = segment[0] << 8 | segment[1];
+                break;
+            case SOS: {
+                if (!has_sof) return false;
+                if (frame.width == 0 || frame.width > 2040 || frame.height == 0 ||
+                    frame.height > 2040) {
+                    return false;
+                }
+                frame.qtables[0] = tables[table_ids[0]];
+                frame.qtables[1] = tables[table_ids[1]];
+                if (!frame.qtables[0] || !frame.qtables[1]) return false;
+                if (frame.restart_interval) frame.type += 64;
+
+                frame.scan     = segment + data_len;
+                frame.scan_len = jpeg + len - frame.scan;
+                // Drop EOI and whatever padding follows it
+                for (size_t i = frame.scan_len; i >= 2; i--) {
+                    if (frame.scan[i - 2] == 0xFF && frame.scan[i - 1] == EOI) {
+                        frame.scan_len = i - 2;
+                        break;
+                    }
+                }
+                return true;
+            }
+            default:
+                // APPn, COM, DHT, ...
+                break;
+        }
+        pos += 2 + segment_len;
+    }
+    return false;
+}
+
+/**
+ * @brief Split the frame into RTP packets
+ *
+ * @param seq RTP sequence number of the first packet, advanced past the last one
+ * @param max_packet Largest RTP packet, headers included
+ * @param send Called with every packet as `(header, header_len, payload, payload_len)`,
+ *             packetizing stops if it returns `false`
+ *
+ * @note Headers are built in a small buffer, the scan data is never copied
+ */
+template <typename Send>
+bool rtp_jpeg_packetize(const RtpJpegFrame_t &frame,
+                        uint16_t             &seq,
+                        const uint32_t        timestamp,
+                        const uint32_t        ssrc,
+                        const size_t          max_packet,
+                        Send                &&send) {
+    uint8_t header[RTP_JPEG_MAX_HEADERS];
+    size_t  offset = 0;
+
+    do {
+        size_t len = 0;
+
+        // RTP header, marker bit is set below on the last packet
+        header[len++] = 0x80;
+        header[len++] = RTP_JPEG_PAYLOAD_TYPE;
+        header[len++] = seq >> 8;
+        header[len++] = seq;
+        for (int shift = 24; shift >= 0; shift -= 8) header[len++] = timestamp >> shift;
+        for (int shift = 24; shift >= 0; shift -= 8) header[len++] = ssrc >> shift;
+
+        // JPEG header, Q = 255 means the tables are in-band
+        header[len++] = 0;
+        header[len++] = offset >> 16;
+        header[len++] = offset >> 8;
+        header[len++] = offset;
+        header[len++] = frame.type;
+        header[len++] = 255;
+        header[len++] = frame.width / 8;
+        header[len++] = frame.height / 8;
+
+        if (frame.restart_interval) {
+            header[len++] = frame.restart_interval >> 8;
+            header[len++] = frame.restart_interval;
+            // First and last of all the restart intervals
+            header[len++] = 0xFF;
+            header[len++] = 0xFF;
+        }
+
+        if (offset == 0) {
+            header[len++] = 0;
+            header[len++] = 0;
+            header[len++] = (2 * RTP_JPEG_QTABLE_SIZE) >> 8;
+            header[len++] = (2 * RTP_JPEG_QTABLE_SIZE) & 0xFF;
+            memcpy(header + len, frame.qtables[0], RTP_JPEG_QTABLE_SIZE);
+            len += RTP_JPEG_QTABLE_SIZE;
+            memcpy(header + len, frame.qtables[1], RTP_JPEG_QTABLE_SIZE);
+            len += RTP_JPEG_QTABLE_SIZE;
+        }
+
+        size_t payload_len = max_packet - len;
+        if (payload_len >= frame.scan_len - offset) {
+            payload_len  = frame.scan_len - offset;
+            header[1]   |= 0x80;
+        }
+
+        if (!send(static_cast<const uint8_t *>(header),
+                  len,
+                  frame.scan + offset,
+                  payload_len)) {
+            return false;
+        }
+        seq++;
+        offset += payload_len;
+    } while (offset < frame.scan_len);
+
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_err.h>
+
+#include <lwip/sockets.h>
+
+/**
+ * @brief Write all the buffers, resuming after partial writes
+ *
+ * @note `iov` is modified to track progress
+ */
+inline esp_err_t send_all(int fd, iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        const ssize_t written = lwip_writev(fd, iov, iovcnt);
+        if (written < 0) return ESP_FAIL;
+        size_t left = written;
+        while (iovcnt > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base  = static_cast<uint8_t *>(iov->iov_base) + left;
+            iov->iov_len  -= left;
+        }
+    }
+    return ESP_OK;
+}
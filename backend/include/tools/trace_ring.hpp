@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <new>
+
+/// A finished span, times in us
+struct TraceEvent_s {
+    /// String literal, never copied
+    const char *name     = nullptr;
+    int64_t     start    = 0;
+    uint32_t    duration = 0;
+    uint8_t     core     = 0;
+};
+using TraceEvent_t = struct TraceEvent_s;
+
+struct TraceSlot_s {
+    /// Index of the event + 1, 0 while it is being written
+    std::atomic<uint32_t> seq{0};
+    TraceEvent_t          event{};
+};
+using TraceSlot_t = struct TraceSlot_s;
+
+/**
+ * @brief Fixed ring of trace events, the oldest ones are overwritten
+ *
+ * @note `record` and `for_each` are lock-free and can be called from any task.
+ *       Every slot is a seqlock, so events overwritten while being read are
+ *       skipped instead of torn
+ */
+class TraceRing {
+    TraceSlot_t          *slots = nullptr;
+    uint32_t              mask  = 0;
+    std::atomic<uint32_t> head{0};
+
+  public:
+    /**
+     * @brief Use `slots` as the ring, before anything is recorded
+     *
+     * @param slots    Raw memory for `capacity` slots, must outlive the ring
+     * @param capacity Power of two
+     */
+    void attach(void *slots, const size_t capacity) {
+        this->slots = static_cast<TraceSlot_t *>(slots);
+        for (size_t i = 0; i < capacity; i++) new (&this->slots[i]) TraceSlot_t{};
+        this->mask = capacity - 1;
+    }
+
+    bool   attached() const { return this->slots != nullptr; }
+    size_t capacity() const { return this->attached() ? this->mask + 1 : 0; }
+    /// Events recorded since boot, overwritten ones included
+    uint32_t recorded() const { return this->head.load(std::memory_order_relaxed); }
+
+    void record(const TraceEvent_t &event) {
+        if (!this->attached()) return;
+
+        const uint32_t index = this->head.fetch_add(1, std::memory_order_relaxed);
+        TraceSlot_t   &slot  = this->slots[index & this->mask];
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.event = event;
+        slot.seq.store(index + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Call `fn(const TraceEvent_t &)` for every event in the ring, oldest first
+     *
+     * @return Number of events visited
+     */
+    template <typename F>
+    size_t for_each(F &&fn) const {
+        if (!this->attached()) return 0;
+
+        const uint32_t end   = this->head.load(std::memory_order_acquire);
+        const uint32_t count = end < this->capacity() ? end : this->capacity();
+        size_t         seen  = 0;
+        for (uint32_t index = end - count; index != end; index++) {
+            const TraceSlot_t &slot = this->slots[index & this->mask];
+            if (slot.seq.load(std::memory_order_acquire) != index + 1) continue;
+            const TraceEvent_t event = slot.event;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != index + 1) continue;
+            fn(event);
+            seen++;
+        }
+        return seen;
+    }
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+/**
+ * @brief Scope-based trace points, dumped by `/debug/trace` as Chrome trace JSON
+ *
+ * Enabled with `-DTRACE_ENABLED=1`, otherwise the macros expand to nothing and
+ * neither the ring nor the endpoint are built
+ */
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+#if TRACE_ENABLED
+
+#include <cstdint>
+
+#include <esp_http_server.h>
+#include <esp_timer.h>
+
+#include <freertos/FreeRTOS.h>
+
+namespace trace {
+    void record(const char *name, int64_t start, int64_t end);
+
+    /**
+     * @brief Send the ring as Chrome `trace_event` JSON, in chunks
+     */
+    esp_err_t send_json(httpd_req_t *req);
+
+    /**
+     * @brief Allocate the ring, before the first trace point
+     */
+    void start();
+
+    /// Records the time between its construction and destruction
+    class Scope {
+        const char   *name;
+        const int64_t start = esp_timer_get_time();
+
+      public:
+        explicit Scope(const char *name) : name(name) {}
+        ~Scope() { record(this->name, this->start, esp_timer_get_time()); }
+
+        Scope(const Scope &)            = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+}  // namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b)  TRACE_CONCAT_(a, b)
+/// Trace the rest of the enclosing scope, `name` must be a string literal
+#define TRACE_SCOPE(name)   const trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#else
+
+namespace trace {
+    inline void start() {}
+}
+
+#define TRACE_SCOPE(name) static_cast<void>(0)
+
+#endif
@@ -72,6 +72,13 @@ static_assert(sizeof(framesize_names) / sizeof(framesize_names[0]) == FRAMESIZE_
 #undef X
 #undef FRAMESIZES
 
+/**
+ * @brief Pixels of a frame size, `framesize_t` is not ordered by them past UXGA
+ */
+inline size_t framesize_pixels(const framesize_t framesize) {
+    return resolution[framesize].width * resolution[framesize].height;
+}
+
 inline framesize_t get_max_framesize(camera_sensor_info_t* si) {
     // clang-format off
     switch (si->pid) {
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <string_view>
+
+// =============================
+// Sensor controls
+// =============================
+
+#pragma region
+
+/**
+ * @brief Controls of `/sensor`, read, written and documented from this list
+ *
+ * X(key, value, minimum, maximum, format)
+ * - `value` reads the control from `sensor_t *s`, `s->set_<key>` writes it
+ * - `minimum` and `maximum` are the accepted range, checked before the setter is called
+ * - `format` is the OpenAPI integer format
+ */
+#define SENSOR_CONTROLS                                       \
+    X(pixformat, s->pixformat, 0, 8, uint8)                   \
+    X(framesize, s->status.framesize, 0, 21, int32)           \
+    X(brightness, s->status.brightness, -2, 2, int8)          \
+    X(contrast, s->status.contrast, -2, 2, int8)              \
+    X(saturation, s->status.saturation, -2, 2, int8)          \
+    X(sharpness, s->status.sharpness, -2, 2, int8)            \
+    X(denoise, s->status.denoise, 0, 255, uint8)              \
+    X(gainceiling, s->status.gainceiling, 0, 6, int8)         \
+    X(quality, s->status.quality, 1, 63, uint8)               \
+    X(colorbar, s->status.colorbar, 0, 1, uint8)              \
+    X(whitebal, s->status.awb, 0, 255, uint8)                 \
+    X(gain_ctrl, s->status.agc, 0, 255, uint8)                \
+    X(exposure_ctrl, s->status.aec, 0, 255, uint8)            \
+    X(hmirror, s->status.hmirror, 0, 1, uint8)                \
+    X(vflip, s->status.vflip, 0, 1, uint8)                    \
+    X(aec2, s->status.aec2, 0, 255, uint8)                    \
+    X(awb_gain, s->status.awb_gain, 0, 255, uint8)            \
+    X(agc_gain, s->status.agc_gain, 0, 30, uint8)             \
+    X(aec_value, s->status.aec_value, 0, 65535, uint16)       \
+    X(special_effect, s->status.special_effect, 0, 6, uint8)  \
+    X(wb_mode, s->status.wb_mode, 0, 4, uint8)                \
+    X(ae_level, s->status.ae_level, -2, 2, int8)              \
+    X(dcw, s->status.dcw, 0, 255, uint8)                      \
+    X(bpc, s->status.bpc, 0, 255, uint8)                      \
+    X(wpc, s->status.wpc, 0, 255, uint8)                      \
+    X(raw_gma, s->status.raw_gma, 0, 255, uint8)              \
+    X(lenc, s->status.lenc, 0, 255, uint8)
+
+/// Indices into `sensor_controls`
+enum SensorControl_e : uint8_t {
+#define X(key, value, minimum, maximum, format) SENSOR_CONTROL_##key,
+    SENSOR_CONTROLS
+#undef X
+    SENSOR_CONTROL_COUNT,
+};
+using SensorControl_t = enum SensorControl_e;
+
+struct SensorControlInfo_s {
+    std::string_view key;
+    int32_t          minimum;
+    int32_t          maximum;
+    std::string_view format;
+};
+using SensorControlInfo_t = struct SensorControlInfo_s;
+
+#define X(key, value, minimum, maximum, format) {#key, minimum, maximum, #format},
+constexpr inline SensorControlInfo_t sensor_controls[] = {SENSOR_CONTROLS};
+#undef X
+static_assert(sizeof(sensor_controls) / sizeof(sensor_controls[0]) == SENSOR_CONTROL_COUNT,
+              "sensor_controls size mismatch");
+
+/**
+ * @brief Keys of `sensor_controls`, in order, for `PerfectHash`
+ */
+constexpr std::array<std::string_view, SENSOR_CONTROL_COUNT> sensor_control_keys() {
+    std::array<std::string_view, SENSOR_CONTROL_COUNT> keys{};
+    for (size_t i = 0; i < SENSOR_CONTROL_COUNT; i++) keys[i] = sensor_controls[i].key;
+    return keys;
+}
+
+#pragma endregion
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_camera.h>
+
+// =============================
+// Adaptive quality modes
+// =============================
+
+#pragma region
+
+#define STREAM_ADAPT_MODES \
+    X(OFF)                 \
+    X(FPS)                 \
+    X(BITRATE)
+
+enum StreamAdaptMode_e {
+#define X(mode) STREAM_ADAPT_##mode,
+    STREAM_ADAPT_MODES
+#undef X
+};
+using StreamAdaptMode_t = enum StreamAdaptMode_e;
+
+#define X(mode) #mode,
+constexpr inline const char* const stream_adapt_mode_names[] = {STREAM_ADAPT_MODES};
+static_assert(sizeof(stream_adapt_mode_names) / sizeof(stream_adapt_mode_names[0]) ==
+                  STREAM_ADAPT_BITRATE + 1,
+              "stream_adapt_mode_names size mismatch");
+#undef X
+#undef STREAM_ADAPT_MODES
+
+#pragma endregion
+
+// =============================
+// Stream settings
+// =============================
+
+#pragma region
+
+constexpr uint32_t STREAM_DEFAULT_MAX_FPS        = 0;  // Unlimited
+constexpr uint32_t STREAM_DEFAULT_TARGET_FPS     = 15;
+constexpr uint32_t STREAM_DEFAULT_TARGET_BITRATE = 4000;  // 4 Mbit/s
+constexpr int      STREAM_DEFAULT_MIN_QUALITY    = 8;
+constexpr int      STREAM_DEFAULT_MAX_QUALITY    = 40;
+
+struct StreamSettings_s {
+    /// Frame rate cap for every stream client, 0 means as fast as the sensor goes
+    uint32_t max_fps = STREAM_DEFAULT_MAX_FPS;
+
+    /// What the adaptive quality controller holds, `OFF` keeps `camera.jpeg_quality`
+    StreamAdaptMode_t adapt_mode = STREAM_ADAPT_OFF;
+    /// Frame rate to hold in `FPS` mode
+    uint32_t target_fps = STREAM_DEFAULT_TARGET_FPS;
+    /// Bitrate in kbit/s to hold in `BITRATE` mode
+    uint32_t target_bitrate = STREAM_DEFAULT_TARGET_BITRATE;
+
+    /// Best JPEG quality the controller may use. 0-63 lower means higher quality
+    int min_quality = STREAM_DEFAULT_MIN_QUALITY;
+    /// Worst JPEG quality the controller may use. 0-63 lower means higher quality
+    int max_quality = STREAM_DEFAULT_MAX_QUALITY;
+
+    /// Also step the frame size down once the worst quality is not enough
+    bool adapt_framesize = false;
+    /// Smallest frame size the controller may use.
+    /// The largest one is `camera.frame_size`, frame buffers are sized for it
+    framesize_t min_framesize = FRAMESIZE_QVGA;
+};
+using StreamSettings_t = struct StreamSettings_s;
+
+#pragma endregion
+
+// =============================
+// Multicast settings
+// =============================
+
+#pragma region
+
+constexpr uint8_t  MULTICAST_DEFAULT_GROUP[4] = {239, 255, 0, 1};
+constexpr uint16_t MULTICAST_DEFAULT_PORT     = 5000;
+constexpr uint8_t  MULTICAST_DEFAULT_TTL      = 1;  // Stay on the LAN
+
+struct MulticastSettings_s {
+    /// Send every frame to the group, independently of the stream clients
+    bool enabled = false;
+    /// Send an XOR parity fragment after every frame, recovers one lost fragment
+    bool fec = false;
+    /// Destination group and port
+    IPAddress group{IPv4, MULTICAST_DEFAULT_GROUP};
+    uint16_t  port = MULTICAST_DEFAULT_PORT;
+    uint8_t   ttl  = MULTICAST_DEFAULT_TTL;
+    /// Frame rate cap, 0 means as fast as `stream.max_fps` allows
+    uint32_t max_fps = 0;
+};
+using MulticastSettings_t = struct MulticastSettings_s;
+
+#pragma endregion
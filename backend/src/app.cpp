@@ -1,19 +1,43 @@
 #include "app.hpp"
 
+#include <cstdarg>
+#include <algorithm>
 #include <memory>
+#include <string_view>
+#include <utility>
 
 #include <esp_log.h>
 #include <esp_http_server.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <esp_rom_crc.h>
 #include <esp_camera.h>
+#include <img_converters.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 
 #include <FS.h>
 #include <SPIFFS.h>
 
 #include "hw/camera.hpp"
 #include "types/camera.hpp"
+#include "types/sensor.hpp"
 #include "types/wifi.hpp"
 #include "config.hpp"
 #include "json.hpp"
+#include "stream.hpp"
+#include "rtsp.hpp"
+#include "multicast.hpp"
+#include "tools/accept_encoding.hpp"
+#include "tools/constexpr_json.hpp"
+#include "tools/gzip.hpp"
+#include "tools/perfect_hash.hpp"
+#include "tools/http_chunk_writer.hpp"
+#include "boot.hpp"
+#include "trace.hpp"
 
 #include <StreamUtils.h>
 
@@ -23,206 +47,80 @@
 
 using unique_buf_t = std::unique_ptr<char, decltype(&free)>;
 
-static constexpr const char *const Settings_schema = []() {
-    return R"json(
+static constexpr std::string_view Settings_schema_json = R"json(
 {}
 )json";
-}();
 
-static constexpr const char *const Sensor_schema = []() {
-    return R"json(
-{
-    "$schema": "http://json-schema.org/draft-07/schema#",
-    "type": "object",
-    "properties": {
-        "framesize": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 21,
-            "format": "int32"
-        },
-        "brightness": {
-            "type": "integer",
-            "minimum": -2,
-            "maximum": 2,
-            "format": "int8"
-        },
-        "contrast": {
-            "type": "integer",
-            "minimum": -2,
-            "maximum": 2,
-            "format": "int8"
-        },
-        "saturation": {
-            "type": "integer",
-            "minimum": -2,
-            "maximum": 2,
-            "format": "int8"
-        },
-        "sharpness": {
-            "type": "integer",
-            "minimum": -2,
-            "maximum": 2,
-            "format": "int8"
-        },
-        "denoise": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "gainceiling": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 6,
-            "format": "int8"
-        },
-        "quality": {
-            "type": "integer",
-            "minimum": 1,
-            "maximum": 63,
-            "format": "uint8"
-        },
-        "colorbar": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 1,
-            "format": "uint8"
-        },
-        "whitebal": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "gain_ctrl": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "exposure_ctrl": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "hmirror": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 1,
-            "format": "uint8"
-        },
-        "vflip": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 1,
-            "format": "uint8"
-        },
-        "aec2": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "awb_gain": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "agc_gain": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 30,
-            "format": "uint8"
-        },
-        "aec_value": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 65535,
-            "format": "uint16"
-        },
-        "special_effect": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 6,
-            "format": "uint8"
-        },
-        "wb_mode": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 4,
-            "format": "uint8"
-        },
-        "ae_level": {
-            "type": "integer",
-            "minimum": -2,
-            "maximum": 2,
-            "format": "int8"
-        },
-        "dcw": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "bpc": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "wpc": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "raw_gma": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        },
-        "lenc": {
-            "type": "integer",
-            "minimum": 0,
-            "maximum": 255,
-            "format": "uint8"
-        }
-    },
-    "additionalProperties": true,
-    "required": [
-        "framesize",
-        "brightness",
-        "saturation",
-        "sharpness",
-        "denoise",
-        "gainceiling",
-        "quality",
-        "colorbar",
-        "whitebal",
-        "gain_ctrl",
-        "exposure_ctrl",
-        "hmirror",
-        "vflip",
-        "aec2",
-        "awb_gain",
-        "agc_gain",
-        "aec_value",
-        "special_effect",
-        "wb_mode",
-        "ae_level",
-        "dcw",
-        "bpc",
-        "wpc",
-        "raw_gma",
-        "lenc"
-    ]
+/**
+ * @brief Sensor schema, from the control list
+ */
+template <size_t N>
+constexpr JsonText<N> sensor_schema_text() {
+    JsonText<N> out;
+    out.append(R"({"$schema":"http://json-schema.org/draft-07/schema#","type":"object",)");
+    out.append(R"("properties":{)");
+    for (size_t i = 0; i < SENSOR_CONTROL_COUNT; i++) {
+        const SensorControlInfo_t &control = sensor_controls[i];
+        if (i > 0) out.append(",");
+        out.append("\"");
+        out.append(control.key);
+        out.append(R"(":{"type":"integer","minimum":)");
+        out.append(control.minimum);
+        out.append(R"(,"maximum":)");
+        out.append(control.maximum);
+        out.append(R"(,"format":")");
+        out.append(control.format);
+        out.append("\"}");
+    }
+    out.append(R"(},"additionalProperties":true,"required":[)");
+    for (size_t i = 0; i < SENSOR_CONTROL_COUNT; i++) {
+        if (i > 0) out.append(",");
+        out.append("\"");
+        out.append(sensor_controls[i].key);
+        out.append("\"");
+    }
+    out.append("]}");
+    return out;
 }
-)json";
+
+static constexpr auto Sensor_schema_text =
+    sensor_schema_text<sensor_schema_text<0>().size()>();
+static constexpr std::string_view Sensor_schema_json = Sensor_schema_text.view();
+
+static_assert(json_valid(Settings_schema_json), "Settings_schema is not valid JSON");
+static_assert(json_valid(Sensor_schema_json), "Sensor_schema is not valid JSON");
+
+// Only the minified schemas end up in flash
+static constexpr auto Settings_schema_minified =
+    json_minify<json_minified_size(Settings_schema_json)>(Settings_schema_json);
+static constexpr auto Sensor_schema_minified =
+    json_minify<json_minified_size(Sensor_schema_json)>(Sensor_schema_json);
+static constexpr const char *const Settings_schema = Settings_schema_minified.data();
+static constexpr const char *const Sensor_schema   = Sensor_schema_minified.data();
+
+/// Spliced as is into the OpenAPI document, the whole schema if it has no `properties`
+static constexpr std::string_view Settings_properties = []() {
+    const std::string_view properties = json_pointer(Settings_schema, "/properties");
+    return properties.empty() ? std::string_view(Settings_schema) : properties;
 }();
+static constexpr std::string_view Sensor_properties = json_pointer(Sensor_schema, "/properties");
+/// Replaced by the largest frame size of the sensor
+static constexpr std::string_view Sensor_framesize_maximum =
+    json_pointer(Sensor_properties, "/framesize/maximum");
+static_assert(!Sensor_framesize_maximum.empty(), "Sensor_schema has no framesize maximum");
+
+/**
+ * @brief Addresses the servers are reachable at, for the OpenAPI `servers`
+ */
+inline void server_addresses(IPAddress &ipv4, IPAddress &ipv6) {
+    if (WiFi.getMode() == WIFI_AP) {
+        ipv4 = WiFi.softAPIP();
+        ipv6 = WiFi.softAPlinkLocalIPv6();
+    } else {
+        ipv4 = WiFi.localIP();
+        ipv6 = WiFi.linkLocalIPv6();
+    }
+}
 
 inline String generate_openapi_json(sensor_t *s) {
     JsonDocument doc;
@@ -238,12 +136,9 @@ inline String generate_openapi_json(sensor_t *s) {
     //{}
     JsonArray servers = doc["servers"].template to<JsonArray>();
     {
-        IPAddress ipv4 = WiFi.localIP();
-        IPAddress ipv6 = WiFi.linkLocalIPv6();
-        if (WiFi.getMode() == WIFI_AP) {
-            ipv4 = WiFi.softAPIP();
-            ipv6 = WiFi.softAPlinkLocalIPv6();
-        }
+        IPAddress ipv4;
+        IPAddress ipv6;
+        server_addresses(ipv4, ipv6);
         JsonObject ipv4_server = servers[0].template to<JsonObject>();
         {
             ipv4_server["url"] = "http://" + ipv4.toString() + ":{port}";
@@ -253,7 +148,6 @@ inline String generate_openapi_json(sensor_t *s) {
                 {
                     ports.add(80);
                     ports.add(81);
-                    ports.add(3232);
                 }
                 vars["port"]["default"] = "80";
             }
@@ -268,7 +162,6 @@ inline String generate_openapi_json(sensor_t *s) {
                     {
                         ports.add(80);
                         ports.add(81);
-                        ports.add(3232);
                     }
                     vars["port"]["default"] = "80";
                 }
@@ -313,6 +206,8 @@ inline String generate_openapi_json(sensor_t *s) {
                         JsonObject content     = res_200["content"].template to<JsonObject>();
                         { content["text/html"]["schema"]["type"] = "string"; }
                     }
+                    JsonObject res_304 = responses["304"].template to<JsonObject>();
+                    { res_304["description"] = "Unchanged since the ETag in If-None-Match"; }
                 }
             }
         }
@@ -332,6 +227,8 @@ inline String generate_openapi_json(sensor_t *s) {
                         JsonObject content     = res_200["content"].template to<JsonObject>();
                         { content["text/html"]["schema"]["type"] = "string"; }
                     }
+                    JsonObject res_304 = responses["304"].template to<JsonObject>();
+                    { res_304["description"] = "Unchanged since the ETag in If-None-Match"; }
                 }
             }
         }
@@ -351,6 +248,8 @@ inline String generate_openapi_json(sensor_t *s) {
                         JsonObject content     = res_200["content"].template to<JsonObject>();
                         { content["application/json"]["schema"]["type"] = "string"; }
                     }
+                    JsonObject res_304 = responses["304"].template to<JsonObject>();
+                    { res_304["description"] = "Unchanged since the ETag in If-None-Match"; }
                 }
             }
         }
@@ -468,6 +367,15 @@ inline String generate_openapi_json(sensor_t *s) {
                 get["summary"]       = "Camera Stream";
                 get["description"]   = "Camera Live Stream";
                 get["operationId"]   = "getStream";
+                JsonObject fps       = get["parameters"][0].template to<JsonObject>();
+                {
+                    fps["name"]                       = "fps";
+                    fps["in"]                         = "query";
+                    fps["description"]                = "Frame rate limit";
+                    fps["required"]                   = false;
+                    fps["schema"]["type"]             = "number";
+                    fps["schema"]["exclusiveMinimum"] = 0;
+                }
                 JsonObject responses = get["responses"].template to<JsonObject>();
                 {
                     JsonObject res_200 = responses["200"].template to<JsonObject>();
@@ -482,6 +390,156 @@ inline String generate_openapi_json(sensor_t *s) {
                 }
             }
         }
+        JsonObject stream_meta = paths["/stream/meta"].template to<JsonObject>();
+        {
+            JsonObject get = stream_meta["get"].template to<JsonObject>();
+            {
+                get["tags"][0]       = "Stream";
+                get["summary"]       = "Camera Stream Metadata";
+                get["description"]   = "One Server-Sent Event per frame with the sequence number, "
+                                       "capture timestamp and capture-to-send latency in us, size, "
+                                       "dimensions, exposure and gain. The same values are in the "
+                                       "`X-` headers of every `/stream` part";
+                get["operationId"]   = "getStreamMeta";
+                JsonObject fps       = get["parameters"][0].template to<JsonObject>();
+                {
+                    fps["name"]                       = "fps";
+                    fps["in"]                         = "query";
+                    fps["description"]                = "Frame rate limit";
+                    fps["required"]                   = false;
+                    fps["schema"]["type"]             = "number";
+                    fps["schema"]["exclusiveMinimum"] = 0;
+                }
+                JsonObject responses = get["responses"].template to<JsonObject>();
+                {
+                    JsonObject res_200 = responses["200"].template to<JsonObject>();
+                    {
+                        res_200["description"] = "Frame Metadata";
+                        JsonObject content     = res_200["content"].template to<JsonObject>();
+                        { content["text/event-stream"]["schema"]["type"] = "string"; }
+                    }
+                }
+            }
+        }
+        JsonObject ws_stream = paths["/ws/stream"].template to<JsonObject>();
+        {
+            JsonObject get = ws_stream["get"].template to<JsonObject>();
+            {
+                get["tags"][0]       = "Stream";
+                get["summary"]       = "Camera WebSocket Stream";
+                get["description"]   = "One binary message per frame: little-endian header "
+                                       "(u64 timestamp in us, u32 sequence, u16 width, u16 height) "
+                                       "followed by the JPEG. Accepts text control messages "
+                                       "`{\"fps\": number, \"quality\": integer}`";
+                get["operationId"]   = "getWsStream";
+                JsonObject responses = get["responses"].template to<JsonObject>();
+                {
+                    JsonObject res_101 = responses["101"].template to<JsonObject>();
+                    { res_101["description"] = "Switching Protocols"; }
+                }
+            }
+        }
+        JsonObject capture = paths["/capture"].template to<JsonObject>();
+        {
+            JsonObject get = capture["get"].template to<JsonObject>();
+            {
+                get["tags"][0]     = "Stream";
+                get["summary"]     = "Camera Capture";
+                get["description"] = "Single JPEG frame, served from cache if it is fresh enough. "
+                                     "Also available as `/capture.bmp` and `/capture.raw`";
+                get["operationId"] = "getCapture";
+                JsonObject max_age = get["parameters"][0].template to<JsonObject>();
+                {
+                    max_age["name"]              = "max_age";
+                    max_age["in"]                = "query";
+                    max_age["description"]       = "Maximum age of a cached frame in ms";
+                    max_age["required"]          = false;
+                    max_age["schema"]["type"]    = "integer";
+                    max_age["schema"]["minimum"] = 0;
+                    max_age["schema"]["default"] = CAPTURE_DEFAULT_MAX_AGE;
+                }
+                JsonObject responses = get["responses"].template to<JsonObject>();
+                {
+                    JsonObject res_200 = responses["200"].template to<JsonObject>();
+                    {
+                        res_200["description"] = "Camera Frame";
+                        JsonObject content     = res_200["content"].template to<JsonObject>();
+                        {
+                            content["image/jpeg"]["schema"]["type"]   = "string";
+                            content["image/jpeg"]["schema"]["format"] = "binary";
+                        }
+                    }
+                    JsonObject res_503 = responses["503"].template to<JsonObject>();
+                    {
+                        res_503["description"] = "No frame captured in time";
+                        JsonObject content     = res_503["content"].template to<JsonObject>();
+                        { content["text/plain"]["schema"]["type"] = "string"; }
+                    }
+                }
+            }
+        }
+        JsonObject metrics = paths["/metrics"].template to<JsonObject>();
+        {
+            JsonObject get = metrics["get"].template to<JsonObject>();
+            {
+                get["tags"][0]       = "App";
+                get["summary"]       = "Metrics";
+                get["description"]   = "Frame counters, stream histograms, heap, Wi-Fi, task stack "
+                                       "and server statistics in the Prometheus text format";
+                get["operationId"]   = "getMetrics";
+                JsonObject responses = get["responses"].template to<JsonObject>();
+                {
+                    JsonObject res_200 = responses["200"].template to<JsonObject>();
+                    {
+                        res_200["description"] = "Metrics";
+                        JsonObject content     = res_200["content"].template to<JsonObject>();
+                        { content["text/plain"]["schema"]["type"] = "string"; }
+                    }
+                }
+            }
+        }
+        JsonObject boot = paths["/debug/boot"].template to<JsonObject>();
+        {
+            JsonObject get = boot["get"].template to<JsonObject>();
+            {
+                get["tags"][0]       = "App";
+                get["summary"]       = "Boot report";
+                get["description"]   = "Start and duration of each boot stage in ms, on the core "
+                                       "that ran it, along with marks like the first frame";
+                get["operationId"]   = "getBoot";
+                JsonObject responses = get["responses"].template to<JsonObject>();
+                {
+                    JsonObject res_200 = responses["200"].template to<JsonObject>();
+                    {
+                        res_200["description"] = "Boot report";
+                        JsonObject content     = res_200["content"].template to<JsonObject>();
+                        { content["application/json"]["schema"]["type"] = "object"; }
+                    }
+                }
+            }
+        }
+#if TRACE_ENABLED
+        JsonObject trace = paths["/debug/trace"].template to<JsonObject>();
+        {
+            JsonObject get = trace["get"].template to<JsonObject>();
+            {
+                get["tags"][0]       = "App";
+                get["summary"]       = "Trace";
+                get["description"]   = "Latest trace events in the Chrome trace_event format, "
+                                       "to be loaded into Perfetto";
+                get["operationId"]   = "getTrace";
+                JsonObject responses = get["responses"].template to<JsonObject>();
+                {
+                    JsonObject res_200 = responses["200"].template to<JsonObject>();
+                    {
+                        res_200["description"] = "Trace";
+                        JsonObject content     = res_200["content"].template to<JsonObject>();
+                        { content["application/json"]["schema"]["type"] = "object"; }
+                    }
+                }
+            }
+        }
+#endif
         // JsonObject ota = paths["/ota"].template to<JsonObject>();
         //{}
     }
@@ -491,36 +549,25 @@ inline String generate_openapi_json(sensor_t *s) {
         {
             JsonObject Settings = schemas["Settings"].template to<JsonObject>();
             {
-                Settings["type"] = "object";
-                JsonDocument         tmp;
-                DeserializationError error = deserializeJson(tmp, Settings_schema);
-                if (error) {
-                    log_e("deserializeJson() failed: %s", error.c_str());
-                } else {
-                    if (tmp.containsKey("properties")) {
-                        Settings["properties"] = tmp["properties"].template as<JsonObject>();
-                    } else {
-                        Settings["properties"] = tmp.template as<JsonObject>();
-                    }
-                }
+                Settings["type"]       = "object";
+                Settings["properties"] = serialized(Settings_properties.data(),
+                                                    Settings_properties.size());
             }
             JsonObject Sensor = schemas["Sensor"].template to<JsonObject>();
             {
                 Sensor["type"] = "object";
-                JsonDocument         tmp;
-                DeserializationError error = deserializeJson(tmp, Sensor_schema);
-                if (error) {
-                    log_e("deserializeJson() failed: %s", error.c_str());
-                } else {
-                    if (tmp.containsKey("properties")) {
-                        auto si       = esp_camera_sensor_get_info(&s->id);
-                        auto max_size = get_max_framesize(si);
-                        tmp["properties"]["framesize"]["maximum"] = max_size;
-                        Sensor["properties"] = tmp["properties"].template as<JsonObject>();
-                    } else {
-                        Sensor["properties"] = tmp.template as<JsonObject>();
-                    }
-                }
+                auto si        = esp_camera_sensor_get_info(&s->id);
+                auto max_size  = get_max_framesize(si);
+
+                // Pre-serialized, only the framesize maximum is written at runtime
+                const size_t head = Sensor_framesize_maximum.data() - Sensor_properties.data();
+                const size_t tail = head + Sensor_framesize_maximum.size();
+                String       properties;
+                properties.reserve(Sensor_properties.size() + 4);
+                properties.concat(Sensor_properties.data(), head);
+                properties += static_cast<int>(max_size);
+                properties.concat(Sensor_properties.data() + tail, Sensor_properties.size() - tail);
+                Sensor["properties"] = serialized(properties);
             }
         }
     }
@@ -532,8 +579,7 @@ inline String generate_openapi_json(sensor_t *s) {
     return json;
 }
 
-inline String generate_settings_json(sensor_t *s, bool types = false) {
-    JsonDocument doc;
+inline void build_settings_json(JsonDocument &doc, sensor_t *s, bool types = false) {
     doc = g_settings;
     // Add enum types
     if (types) {
@@ -591,6 +637,23 @@ inline String generate_settings_json(sensor_t *s, bool types = false) {
                     }
                 }
             }
+            JsonObject stream = types["stream"].template to<JsonObject>();
+            {
+                JsonArray adapt_mode = stream["adapt_mode"].template to<JsonArray>();
+                {
+                    for (size_t i = 0;
+                         i < sizeof(stream_adapt_mode_names) / sizeof(stream_adapt_mode_names[0]);
+                         i++) {
+                        adapt_mode.add(stream_adapt_mode_names[i]);
+                    }
+                }
+                JsonArray min_framesize = stream["min_framesize"].template to<JsonArray>();
+                {
+                    for (size_t i = 0; i <= g_settings.camera.frame_size; i++) {
+                        min_framesize.add(framesize_names[i]);
+                    }
+                }
+            }
         }
     }
     {
@@ -606,7 +669,11 @@ inline String generate_settings_json(sensor_t *s, bool types = false) {
         // Remove OTA settings
         doc.remove("ota");
     }
-    doc.shrinkToFit();
+}
+
+inline String generate_settings_json(sensor_t *s, bool types = false) {
+    JsonDocument doc;
+    build_settings_json(doc, s, types);
 
     String json;
     serializeJson(doc, json);
@@ -614,41 +681,15 @@ inline String generate_settings_json(sensor_t *s, bool types = false) {
     return json;
 }
 
+inline void build_sensor_json(JsonDocument &doc, sensor_t *s) {
+#define X(key, value, minimum, maximum, format) doc[#key] = value;
+    SENSOR_CONTROLS
+#undef X
+}
+
 inline String generate_sensor_json(sensor_t *s) {
     JsonDocument doc;
-    doc["pixformat"]     = s->pixformat;
-    doc["framesize"]     = s->status.framesize;
-    doc["brightness"]    = s->status.brightness;
-    doc["contrast"]      = s->status.contrast;
-    doc["saturation"]    = s->status.saturation;
-    doc["sharpness"]     = s->status.sharpness;
-    doc["denoise"]       = s->status.denoise;
-    doc["gainceiling"]   = s->status.gainceiling;
-    doc["quality"]       = s->status.quality;
-    doc["colorbar"]      = s->status.colorbar;
-    doc["whitebal"]      = s->status.awb;
-    doc["gain_ctrl"]     = s->status.agc;
-    doc["exposure_ctrl"] = s->status.aec;
-    doc["hmirror"]       = s->status.hmirror;
-    doc["vflip"]         = s->status.vflip;
-
-    doc["aec2"]      = s->status.aec2;
-    doc["awb_gain"]  = s->status.awb_gain;
-    doc["agc_gain"]  = s->status.agc_gain;
-    doc["aec_value"] = s->status.aec_value;
-
-    doc["special_effect"] = s->status.special_effect;
-    doc["wb_mode"]        = s->status.wb_mode;
-    doc["ae_level"]       = s->status.ae_level;
-
-    doc["dcw"] = s->status.dcw;
-    doc["bpc"] = s->status.bpc;
-    doc["wpc"] = s->status.wpc;
-
-    doc["raw_gma"] = s->status.raw_gma;
-    doc["lenc"]    = s->status.lenc;
-
-    doc.shrinkToFit();
+    build_sensor_json(doc, s);
 
     String json;
     serializeJson(doc, json);
@@ -656,93 +697,286 @@ inline String generate_sensor_json(sensor_t *s) {
     return json;
 }
 
+/// Argument type of a `sensor_t` setter
+template <typename T>
+struct SensorSetterArg_s;
+template <typename T>
+struct SensorSetterArg_s<int (*)(sensor_t *, T)> {
+    using type = T;
+};
+
+using SensorSetter_t = int (*)(sensor_t *s, int32_t value);
+
+#define X(key, value, minimum, maximum, format)                                          \
+    [](sensor_t *s, int32_t arg) {                                                       \
+        using Arg_t = typename SensorSetterArg_s<decltype(sensor_t::set_##key)>::type; \
+        return s->set_##key(s, static_cast<Arg_t>(arg));                                 \
+    },
+/// `s->set_<key>` of every control, in `sensor_controls` order
+static constexpr SensorSetter_t sensor_setters[] = {SENSOR_CONTROLS};
+#undef X
+
+static constexpr PerfectHash<SENSOR_CONTROL_COUNT> sensor_control_hash(sensor_control_keys());
+static_assert(sensor_control_hash.valid(), "No perfect hash found for the sensor controls");
+
+/**
+ * @brief Apply the controls of `obj` to the sensor
+ *
+ * @note Every value is checked first, nothing is applied if any is out of range.
+ *       Unknown keys are ignored
+ *
+ * @return `false` if a value is not an integer or out of range
+ */
 inline bool process_sensor_json(sensor_t *s, JsonObject obj) {
+    auto si       = esp_camera_sensor_get_info(&s->id);
+    auto max_size = get_max_framesize(si);
+
     for (auto kv : obj) {
         const char *key   = kv.key().c_str();
-        uint32_t    value = kv.value().as<uint32_t>();
-        if (strcmp(key, "pixformat") == 0) {
-            s->set_pixformat(s, static_cast<decltype(s->pixformat)>(value));
-        } else if (strcmp(key, "framesize") == 0) {
-            auto fs       = static_cast<decltype(s->status.framesize)>(value);
-            auto si       = esp_camera_sensor_get_info(&s->id);
-            auto max_size = get_max_framesize(si);
-            if (fs > max_size) {
-                log_w("Invalid framesize: %d", fs);
-                return false;
-            }
-            s->set_framesize(s, fs);
-        } else if (strcmp(key, "brightness") == 0) {
-            s->set_brightness(s, static_cast<decltype(s->status.brightness)>(value));
-        } else if (strcmp(key, "contrast") == 0) {
-            s->set_contrast(s, static_cast<decltype(s->status.contrast)>(value));
-        } else if (strcmp(key, "saturation") == 0) {
-            s->set_saturation(s, static_cast<decltype(s->status.saturation)>(value));
-        } else if (strcmp(key, "sharpness") == 0) {
-            s->set_sharpness(s, static_cast<decltype(s->status.sharpness)>(value));
-        } else if (strcmp(key, "denoise") == 0) {
-            s->set_denoise(s, static_cast<decltype(s->status.denoise)>(value));
-        } else if (strcmp(key, "gainceiling") == 0) {
-            s->set_gainceiling(s, static_cast<gainceiling_t>(value));
-        } else if (strcmp(key, "quality") == 0) {
-            s->set_quality(s, static_cast<decltype(s->status.quality)>(value));
-        } else if (strcmp(key, "colorbar") == 0) {
-            s->set_colorbar(s, static_cast<decltype(s->status.colorbar)>(value));
-        } else if (strcmp(key, "whitebal") == 0) {
-            s->set_whitebal(s, static_cast<decltype(s->status.awb)>(value));
-        } else if (strcmp(key, "gain_ctrl") == 0) {
-            s->set_gain_ctrl(s, static_cast<decltype(s->status.agc)>(value));
-        } else if (strcmp(key, "exposure_ctrl") == 0) {
-            s->set_exposure_ctrl(s, static_cast<decltype(s->status.aec)>(value));
-        } else if (strcmp(key, "hmirror") == 0) {
-            s->set_hmirror(s, static_cast<decltype(s->status.hmirror)>(value));
-        } else if (strcmp(key, "vflip") == 0) {
-            s->set_vflip(s, static_cast<decltype(s->status.vflip)>(value));
-        } else if (strcmp(key, "aec2") == 0) {
-            s->set_aec2(s, static_cast<decltype(s->status.aec2)>(value));
-        } else if (strcmp(key, "awb_gain") == 0) {
-            s->set_awb_gain(s, static_cast<decltype(s->status.awb_gain)>(value));
-        } else if (strcmp(key, "agc_gain") == 0) {
-            s->set_agc_gain(s, static_cast<decltype(s->status.agc_gain)>(value));
-        } else if (strcmp(key, "aec_value") == 0) {
-            s->set_aec_value(s, static_cast<decltype(s->status.aec_value)>(value));
-        } else if (strcmp(key, "special_effect") == 0) {
-            s->set_special_effect(s, static_cast<decltype(s->status.special_effect)>(value));
-        } else if (strcmp(key, "wb_mode") == 0) {
-            s->set_wb_mode(s, static_cast<decltype(s->status.wb_mode)>(value));
-        } else if (strcmp(key, "ae_level") == 0) {
-            s->set_ae_level(s, static_cast<decltype(s->status.ae_level)>(value));
-        } else if (strcmp(key, "dcw") == 0) {
-            s->set_dcw(s, static_cast<decltype(s->status.dcw)>(value));
-        } else if (strcmp(key, "bpc") == 0) {
-            s->set_bpc(s, static_cast<decltype(s->status.bpc)>(value));
-        } else if (strcmp(key, "wpc") == 0) {
-            s->set_wpc(s, static_cast<decltype(s->status.wpc)>(value));
-        } else if (strcmp(key, "raw_gma") == 0) {
-            s->set_raw_gma(s, static_cast<decltype(s->status.raw_gma)>(value));
-        } else if (strcmp(key, "lenc") == 0) {
-            s->set_lenc(s, static_cast<decltype(s->status.lenc)>(value));
-        } else {
+        const int   index = sensor_control_hash.find(key);
+        if (index < 0) {
             log_w("Unknown key: %s", key);
+            continue;
+        }
+
+        const SensorControlInfo_t &control = sensor_controls[index];
+        const int32_t              value   = kv.value().as<int32_t>();
+        // The largest frame size depends on the sensor
+        const int32_t maximum = index == SENSOR_CONTROL_framesize ? max_size : control.maximum;
+        if (!(kv.value().is<int32_t>() || kv.value().is<bool>()) || value < control.minimum ||
+            value > maximum) {
+            log_w("Invalid %s: %s", key, kv.value().as<String>().c_str());
+            return false;
         }
     }
 
+    for (auto kv : obj) {
+        const int index = sensor_control_hash.find(kv.key().c_str());
+        if (index >= 0) sensor_setters[index](s, kv.value().as<int32_t>());
+    }
+
     return true;
 }
 
-static esp_err_t api_handler(httpd_req_t *req) {
+/**
+ * @brief Whether `If-None-Match` lists `etag`, or is `*`
+ */
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+    char value[128];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    return strcmp(value, "*") == 0 || strstr(value, etag) != nullptr;
+}
+
+/// The stubs never change, their checksums are taken once
+static const uint32_t index_stub_html_gz_crc =
+    esp_rom_crc32_le(0, index_stub_html_gz, index_stub_html_gz_size);
+static const uint32_t api_stub_html_gz_crc =
+    esp_rom_crc32_le(0, api_stub_html_gz, api_stub_html_gz_size);
+
+/// `"<crc>-<length>"`
+static void bundle_etag(char (&etag)[20], uint32_t crc, size_t len) {
+    snprintf(etag, sizeof(etag), "\"%08lx-%zx\"", static_cast<unsigned long>(crc), len);
+}
+
+/// One encoding of a bundle, `data` is `nullptr` if there is none
+struct BundleVariant_s {
+    const uint8_t *data;
+    size_t         len;
+    /// CRC-32 of `data`, the ETag
+    uint32_t crc;
+    /// `Content-Encoding`
+    const char *encoding;
+};
+using BundleVariant_t = struct BundleVariant_s;
+
+/**
+ * @brief Headers of both the 200 and the 304 response of a bundle
+ *
+ * @note Headers are sent with the response, `etag` must live until then
+ */
+static void bundle_headers(httpd_req_t *req, const char *etag) {
     httpd_resp_set_type(req, "text/html");
-    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", BUNDLE_CACHE_CONTROL);
+    // The encoding, hence the ETag, depends on `Accept-Encoding`
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+}
+
+/**
+ * @brief Send a bundle, in chunks of `BUNDLE_CHUNK_SIZE`
+ */
+static esp_err_t send_bundle_body(httpd_req_t *req, const BundleVariant_t &bundle) {
+    char etag[20];
+    bundle_etag(etag, bundle.crc, bundle.len);
+    bundle_headers(req, etag);
+    httpd_resp_set_hdr(req, "Content-Encoding", bundle.encoding);
+    if (bundle.len <= BUNDLE_CHUNK_SIZE) {
+        return httpd_resp_send(req, reinterpret_cast<const char *>(bundle.data), bundle.len);
+    }
+
+    for (size_t sent = 0; sent < bundle.len; sent += BUNDLE_CHUNK_SIZE) {
+        const size_t    part = std::min(BUNDLE_CHUNK_SIZE, bundle.len - sent);
+        const esp_err_t err  = httpd_resp_send_chunk(
+            req, reinterpret_cast<const char *>(bundle.data + sent), static_cast<ssize_t>(part));
+        if (err != ESP_OK) return err;
+        // Let the other senders have the radio in between
+        taskYIELD();
+    }
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+/// Bundle waiting for a sender, `req` is the async copy
+struct BundleJob_s {
+    httpd_req_t    *req;
+    BundleVariant_t bundle;
+};
+using BundleJob_t = struct BundleJob_s;
+
+/// Only the app server task queues jobs, `nullptr` if the senders didn't start
+static QueueHandle_t bundle_queue = nullptr;
+/// Counts the senders waiting for a job, taken before one is queued
+static SemaphoreHandle_t bundle_idle = nullptr;
+
+/**
+ * @brief Sends the queued bundles, the app server task answers other sockets meanwhile
+ */
+static void bundle_sender_fn(void *) {
+    BundleJob_t job;
+    while (true) {
+        xSemaphoreGive(bundle_idle);
+        if (xQueueReceive(bundle_queue, &job, portMAX_DELAY) != pdTRUE) continue;
+        {
+            TRACE_SCOPE("bundle_send");
+            const esp_err_t err = send_bundle_body(job.req, job.bundle);
+            if (err != ESP_OK) log_w("Failed to send bundle, err: %d", err);
+        }
+        httpd_req_async_handler_complete(job.req);
+    }
+}
+
+/**
+ * @brief Whether `Accept-Encoding` allows `encoding`
+ */
+static bool client_accepts(httpd_req_t *req, const char *encoding) {
+    char            value[128];
+    const esp_err_t err =
+        httpd_req_get_hdr_value_str(req, "Accept-Encoding", value, sizeof(value));
+    // A truncated list is read as far as it goes
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) return false;
+    return accepts_encoding(value, encoding);
+}
+
+/**
+ * @brief Answer with an HTML bundle, 304 if the client has it
+ *
+ * `br` is preferred when there is one and the client accepts it. Large bundles are
+ * handed to an idle sender task, the app server sends them itself when none is
+ */
+static esp_err_t send_bundle(httpd_req_t           *req,
+                             const BundleVariant_t &gz,
+                             const BundleVariant_t &br = {}) {
+    const BundleVariant_t &bundle = br.data && client_accepts(req, br.encoding) ? br : gz;
+
+    char etag[20];
+    bundle_etag(etag, bundle.crc, bundle.len);
+    if (etag_matches(req, etag)) {
+        bundle_headers(req, etag);
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+
+    // An idle sender is taken before queueing, so the job never waits behind another one
+    if (bundle.len <= BUNDLE_CHUNK_SIZE || !bundle_queue ||
+        xSemaphoreTake(bundle_idle, 0) != pdTRUE) {
+        return send_bundle_body(req, bundle);
+    }
+    httpd_req_t    *async_req = nullptr;
+    const esp_err_t err       = httpd_req_async_handler_begin(req, &async_req);
+    if (err != ESP_OK) {
+        log_w("Failed to start async request, err: %d", err);
+        xSemaphoreGive(bundle_idle);
+        return send_bundle_body(req, bundle);
+    }
+    const BundleJob_t job = {async_req, bundle};
+    xQueueSend(bundle_queue, &job, 0);
+    return ESP_OK;
+}
+
+static esp_err_t api_handler(httpd_req_t *req) {
+    TRACE_SCOPE("api_handler");
     if (api_full_html_gz_size > 0) {
-        return httpd_resp_send(req,
-                               reinterpret_cast<const char *>(api_full_html_gz),
-                               api_full_html_gz_size);
+        return send_bundle(req,
+                           {api_full_html_gz, api_full_html_gz_size, api_full_html_gz_crc, "gzip"},
+                           {api_full_html_br, api_full_html_br_size, api_full_html_br_crc, "br"});
     }
-    return httpd_resp_send(req,
-                           reinterpret_cast<const char *>(api_stub_html_gz),
-                           api_stub_html_gz_size);
+    return send_bundle(req,
+                       {api_stub_html_gz, api_stub_html_gz_size, api_stub_html_gz_crc, "gzip"});
+}
+
+/**
+ * @brief Gzipped OpenAPI document, built on the first request
+ *
+ * @note Only the app server task touches it
+ */
+struct OpenApiCache_s {
+    uint8_t *gzip = nullptr;
+    size_t   len  = 0;
+    char     etag[20]{};
+    /// What the document was built for, it is rebuilt when any of them changes
+    IPAddress ipv4{};
+    IPAddress ipv6{};
+    uint16_t  pid = 0;
+};
+using OpenApiCache_t = struct OpenApiCache_s;
+
+static OpenApiCache_t openapi_cache{};
+
+/**
+ * @brief Rebuild `openapi_cache` if the addresses or the sensor changed
+ *
+ * @return `false` if it couldn't be built, `json` then holds the plain document
+ */
+static bool openapi_cache_update(sensor_t *s, String &json) {
+    IPAddress ipv4;
+    IPAddress ipv6;
+    server_addresses(ipv4, ipv6);
+    if (openapi_cache.gzip && openapi_cache.ipv4 == ipv4 && openapi_cache.ipv6 == ipv6 &&
+        openapi_cache.pid == s->id.PID) {
+        return true;
+    }
+
+    heap_caps_free(openapi_cache.gzip);
+    openapi_cache = {};
+
+    json = generate_openapi_json(s);
+    size_t   len  = 0;
+    uint8_t *gzip =
+        gzip_compress(json.c_str(), json.length(), &len, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+    if (!gzip) {
+        log_w("Failed to compress the OpenAPI document, sending it as is");
+        return false;
+    }
+
+    const uint32_t crc =
+        esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(json.c_str()), json.length());
+    snprintf(openapi_cache.etag,
+             sizeof(openapi_cache.etag),
+             "\"%08lx-%zx\"",
+             static_cast<unsigned long>(crc),
+             static_cast<size_t>(json.length()));
+    openapi_cache.gzip = gzip;
+    openapi_cache.len  = len;
+    openapi_cache.ipv4 = ipv4;
+    openapi_cache.ipv6 = ipv6;
+    openapi_cache.pid  = s->id.PID;
+    log_i("OpenAPI document cached, %zuB gzipped from %uB", len, json.length());
+    return true;
 }
 
 static esp_err_t openapi_json_handler(httpd_req_t *req) {
+    TRACE_SCOPE("openapi_json_handler");
     httpd_resp_set_type(req, "application/json");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
 
@@ -752,25 +986,62 @@ static esp_err_t openapi_json_handler(httpd_req_t *req) {
 
         return httpd_resp_send_500(req);
     }
-    const String json = generate_openapi_json(s);
 
-    return httpd_resp_send(req, json.c_str(), json.length());
+    String json;
+    if (!openapi_cache_update(s, json)) return httpd_resp_send(req, json.c_str(), json.length());
+
+    httpd_resp_set_hdr(req, "ETag", openapi_cache.etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (etag_matches(req, openapi_cache.etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req,
+                           reinterpret_cast<const char *>(openapi_cache.gzip),
+                           openapi_cache.len);
 }
 
 static esp_err_t index_handler(httpd_req_t *req) {
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    TRACE_SCOPE("index_handler");
     if (index_full_html_gz_size > 0) {
-        return httpd_resp_send(req,
-                               reinterpret_cast<const char *>(index_full_html_gz),
-                               index_full_html_gz_size);
+        return send_bundle(
+            req,
+            {index_full_html_gz, index_full_html_gz_size, index_full_html_gz_crc, "gzip"},
+            {index_full_html_br, index_full_html_br_size, index_full_html_br_crc, "br"});
     }
-    return httpd_resp_send(req,
-                           reinterpret_cast<const char *>(index_stub_html_gz),
-                           index_stub_html_gz_size);
+    return send_bundle(
+        req, {index_stub_html_gz, index_stub_html_gz_size, index_stub_html_gz_crc, "gzip"});
+}
+
+/// Reused by every JSON response, the server handles one request at a time
+static char json_chunk_buf[JSON_CHUNK_SIZE];
+
+/**
+ * @brief Serialize `doc` straight into chunks of `json_chunk_buf`
+ */
+static esp_err_t send_json(httpd_req_t *req, const JsonDocument &doc) {
+    HttpChunkWriter writer(req, json_chunk_buf, sizeof(json_chunk_buf));
+    serializeJson(doc, writer);
+    return writer.end();
+}
+
+/**
+ * @brief Send the rest of `file` in chunks of `json_chunk_buf`
+ */
+static esp_err_t send_file(httpd_req_t *req, File &file) {
+    while (true) {
+        const size_t len =
+            file.read(reinterpret_cast<uint8_t *>(json_chunk_buf), sizeof(json_chunk_buf));
+        if (len == 0) break;
+        const esp_err_t res = httpd_resp_send_chunk(req, json_chunk_buf, len);
+        if (res != ESP_OK) return res;
+    }
+    return httpd_resp_send_chunk(req, nullptr, 0);
 }
 
 static esp_err_t settings_handler(httpd_req_t *req) {
+    TRACE_SCOPE("settings_handler");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     switch (req->method) {
         case HTTP_GET: {
@@ -782,9 +1053,10 @@ static esp_err_t settings_handler(httpd_req_t *req) {
 
                 return httpd_resp_send_500(req);
             }
-            const String json = generate_settings_json(s, true);
+            JsonDocument doc;
+            build_settings_json(doc, s, true);
 
-            return httpd_resp_send(req, json.c_str(), json.length());
+            return send_json(req, doc);
         }
         case HTTP_POST: {
             size_t buf_len = req->content_len;
@@ -806,6 +1078,13 @@ static esp_err_t settings_handler(httpd_req_t *req) {
                                                            HTTPD_400_BAD_REQUEST,
                                                            "Bad Request");
                             }
+                            if (!doc.template is<Settings_t>()) {
+                                log_w("Invalid settings");
+
+                                return httpd_resp_send_err(req,
+                                                           HTTPD_400_BAD_REQUEST,
+                                                           "Bad Request");
+                            }
 
                             new_settings = doc.template as<Settings_t>();
 
@@ -898,11 +1177,11 @@ static esp_err_t settings_handler(httpd_req_t *req) {
 
                             return httpd_resp_send_500(req);
                         }
-                        String json = file.readString();
+                        httpd_resp_set_type(req, "application/json");
+                        const esp_err_t res = send_file(req, file);
                         file.close();
 
-                        httpd_resp_set_type(req, "application/json");
-                        return httpd_resp_send(req, json.c_str(), json.length());
+                        return res;
                     }
                     return httpd_resp_send_500(req);
                 }
@@ -915,6 +1194,7 @@ static esp_err_t settings_handler(httpd_req_t *req) {
 }
 
 static esp_err_t sensor_handler(httpd_req_t *req) {
+    TRACE_SCOPE("sensor_handler");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     switch (req->method) {
         case HTTP_GET: {
@@ -922,9 +1202,10 @@ static esp_err_t sensor_handler(httpd_req_t *req) {
 
             auto s = esp_camera_sensor_get();
             if (s) {
-                const String json = generate_sensor_json(s);
+                JsonDocument doc;
+                build_sensor_json(doc, s);
 
-                return httpd_resp_send(req, json.c_str(), json.length());
+                return send_json(req, doc);
             } else {
                 return httpd_resp_send_500(req);
             }
@@ -956,9 +1237,11 @@ static esp_err_t sensor_handler(httpd_req_t *req) {
                             }
                             httpd_resp_set_type(req, "application/json");
 
-                            const String json = generate_sensor_json(s);
+                            // Reuse the request document for the response
+                            doc.clear();
+                            build_sensor_json(doc, s);
 
-                            return httpd_resp_send(req, json.c_str(), json.length());
+                            return send_json(req, doc);
                         }
                     }
                     return httpd_resp_send_500(req);
@@ -972,11 +1255,417 @@ static esp_err_t sensor_handler(httpd_req_t *req) {
     }
 }
 
+enum CaptureFormat_e {
+    CAPTURE_JPEG,
+    CAPTURE_BMP,
+    CAPTURE_RAW,
+};
+using CaptureFormat_t = enum CaptureFormat_e;
+
+/**
+ * @brief Answer a `/capture` request, waits for a new frame if the cached one is too old
+ */
+static esp_err_t send_capture(httpd_req_t *req) {
+    TRACE_SCOPE("send_capture");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    const auto format = static_cast<CaptureFormat_t>(reinterpret_cast<intptr_t>(req->user_ctx));
+
+    uint32_t max_age = CAPTURE_DEFAULT_MAX_AGE;
+    char     query[32];
+    char     value[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "max_age", value, sizeof(value)) == ESP_OK) {
+        max_age = strtoul(value, nullptr, 10);
+    }
+
+    const stream::Snapshot_t *snapshot = stream::snapshot(static_cast<int64_t>(max_age) * 1000);
+    if (!snapshot) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "No frame captured in time");
+    }
+
+    char timestamp[32];
+    snprintf(timestamp,
+             sizeof(timestamp),
+             "%ld.%06ld",
+             static_cast<long int>(snapshot->timestamp.tv_sec),
+             static_cast<long int>(snapshot->timestamp.tv_usec));
+    httpd_resp_set_hdr(req, "X-Timestamp", timestamp);
+
+    esp_err_t res = ESP_OK;
+    switch (format) {
+        case CAPTURE_JPEG:
+        case CAPTURE_BMP: {
+            httpd_resp_set_type(req, format == CAPTURE_JPEG ? "image/jpeg" : "image/bmp");
+            if (format == CAPTURE_JPEG && snapshot->format == PIXFORMAT_JPEG) {
+                res = httpd_resp_send(req,
+                                      reinterpret_cast<const char *>(snapshot->buf),
+                                      snapshot->len);
+                break;
+            }
+
+            camera_fb_t fb{};
+            fb.buf       = snapshot->buf;
+            fb.len       = snapshot->len;
+            fb.width     = snapshot->width;
+            fb.height    = snapshot->height;
+            fb.format    = snapshot->format;
+            fb.timestamp = snapshot->timestamp;
+
+            uint8_t *buf = nullptr;
+            size_t   len = 0;
+            if (!(format == CAPTURE_JPEG ? frame2jpg(&fb, CAPTURE_JPEG_QUALITY, &buf, &len)
+                                         : frame2bmp(&fb, &buf, &len))) {
+                log_e("Failed to convert the frame");
+                res = httpd_resp_send_500(req);
+                break;
+            }
+            res = httpd_resp_send(req, reinterpret_cast<const char *>(buf), len);
+            free(buf);
+            break;
+        }
+        case CAPTURE_RAW: {
+            char width[12];
+            char height[12];
+            snprintf(width, sizeof(width), "%zu", snapshot->width);
+            snprintf(height, sizeof(height), "%zu", snapshot->height);
+            httpd_resp_set_type(req, "application/octet-stream");
+            httpd_resp_set_hdr(req, "X-Width", width);
+            httpd_resp_set_hdr(req, "X-Height", height);
+            httpd_resp_set_hdr(req, "X-Pixel-Format", pixformat_names[snapshot->format]);
+            res = httpd_resp_send(req,
+                                  reinterpret_cast<const char *>(snapshot->buf),
+                                  snapshot->len);
+            break;
+        }
+    }
+
+    stream::release(snapshot);
+    return res;
+}
+
+/// Only the app server task queues requests, `nullptr` if the worker didn't start
+static QueueHandle_t capture_queue = nullptr;
+
+/**
+ * @brief Answers the queued `/capture` requests, the app server task answers the others meanwhile
+ */
+static void capture_worker_fn(void *) {
+    httpd_req_t *req = nullptr;
+    while (true) {
+        if (xQueueReceive(capture_queue, &req, portMAX_DELAY) != pdTRUE) continue;
+        const esp_err_t err = send_capture(req);
+        if (err != ESP_OK) log_w("Failed to send capture, err: %d", err);
+        httpd_req_async_handler_complete(req);
+    }
+}
+
+static esp_err_t capture_handler(httpd_req_t *req) {
+    TRACE_SCOPE("capture_handler");
+    if (!capture_queue) return send_capture(req);
+
+    // Waiting for a frame would hold up every other request of the app server
+    httpd_req_t    *async_req = nullptr;
+    const esp_err_t err       = httpd_req_async_handler_begin(req, &async_req);
+    if (err != ESP_OK) {
+        log_w("Failed to start async request, err: %d", err);
+        return send_capture(req);
+    }
+    if (xQueueSend(capture_queue, &async_req, 0) != pdTRUE) {
+        httpd_resp_set_hdr(async_req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_set_status(async_req, "503 Service Unavailable");
+        httpd_resp_sendstr(async_req, "Too many captures waiting");
+        httpd_req_async_handler_complete(async_req);
+    }
+    return ESP_OK;
+}
+
+extern httpd_handle_t app_httpd;
+extern httpd_handle_t stream_httpd;
+
+/// Reused by every scrape, the server handles one request at a time
+static char metrics_buf[METRICS_BUFFER_SIZE];
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t metrics_tasks[METRICS_MAX_TASKS];
+#endif
+
+struct MetricsWriter_s {
+    httpd_req_t *req = nullptr;
+    size_t       len = 0;
+    esp_err_t    err = ESP_OK;
+};
+using MetricsWriter_t = struct MetricsWriter_s;
+
+static void metrics_flush(MetricsWriter_t &out) {
+    if (out.err == ESP_OK && out.len > 0) {
+        out.err = httpd_resp_send_chunk(out.req, metrics_buf, out.len);
+    }
+    out.len = 0;
+}
+
+/**
+ * @brief Append a line to `metrics_buf`, sending the buffer first if it doesn't fit
+ */
+__attribute__((format(printf, 2, 3))) static void metrics_printf(MetricsWriter_t &out,
+                                                                 const char      *format,
+                                                                 ...) {
+    for (int attempt = 0; attempt < 2 && out.err == ESP_OK; attempt++) {
+        va_list args;
+        va_start(args, format);
+        const int len =
+            vsnprintf(metrics_buf + out.len, sizeof(metrics_buf) - out.len, format, args);
+        va_end(args);
+        if (len < 0) break;
+        if (out.len + len < sizeof(metrics_buf)) {
+            out.len += len;
+            return;
+        }
+        metrics_flush(out);
+    }
+    if (out.err == ESP_OK) log_w("Metrics line doesn't fit into %zuB", sizeof(metrics_buf));
+}
+
+static void metrics_header(MetricsWriter_t &out,
+                           const char      *name,
+                           const char      *type,
+                           const char      *help) {
+    metrics_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * @brief Export the histogram with one bucket per power of two
+ */
+static void metrics_histogram(MetricsWriter_t                &out,
+                              const char                     *name,
+                              const char                     *help,
+                              const stream::StatsHistogram_t &histogram) {
+    using Histogram_t = stream::StatsHistogram_t;
+
+    metrics_header(out, name, "histogram", help);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i + 1 < Histogram_t::BUCKETS; i++) {
+        cumulative           += histogram.bucket(i);
+        const uint32_t upper  = Histogram_t::bucket_upper(i);
+        if ((upper & (upper + 1)) != 0) continue;
+        metrics_printf(out,
+                       "%s_bucket{le=\"%lu\"} %llu\n",
+                       name,
+                       static_cast<unsigned long>(upper),
+                       static_cast<unsigned long long>(cumulative));
+    }
+    cumulative += histogram.bucket(Histogram_t::BUCKETS - 1);
+    metrics_printf(out,
+                   "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %llu\n%s_count %llu\n",
+                   name,
+                   static_cast<unsigned long long>(cumulative),
+                   name,
+                   static_cast<unsigned long long>(histogram.sum()),
+                   name,
+                   static_cast<unsigned long long>(cumulative));
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req) {
+    TRACE_SCOPE("metrics_handler");
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    MetricsWriter_t        out{.req = req};
+    const stream::Stats_t &stats = stream::stats();
+
+    metrics_header(out, "esp32cam_uptime_seconds", "counter", "Time since boot");
+    metrics_printf(out,
+                   "esp32cam_uptime_seconds %llu\n",
+                   static_cast<unsigned long long>(esp_timer_get_time() / 1000000));
+
+    metrics_header(out,
+                   "esp32cam_frames_captured_total",
+                   "counter",
+                   "Frames taken from the camera");
+    metrics_printf(out, "esp32cam_frames_captured_total %lu\n", stats.captured.load());
+    metrics_header(out, "esp32cam_frames_sent_total", "counter", "Frames sent to the clients");
+    metrics_printf(out, "esp32cam_frames_sent_total %lu\n", stats.sent.load());
+    metrics_header(out,
+                   "esp32cam_frames_dropped_total",
+                   "counter",
+                   "Frames skipped by clients still sending an older one");
+    metrics_printf(out, "esp32cam_frames_dropped_total %lu\n", stats.dropped.load());
+
+    metrics_histogram(out,
+                      "esp32cam_frame_interval_microseconds",
+                      "Time between published frames",
+                      stats.frame_time);
+    metrics_histogram(out, "esp32cam_frame_size_bytes", "Published JPEG size", stats.frame_size);
+    metrics_histogram(out,
+                      "esp32cam_encode_time_microseconds",
+                      "Time to encode a raw frame to JPEG",
+                      stats.encode_time);
+    metrics_histogram(out,
+                      "esp32cam_send_time_microseconds",
+                      "Time to write a frame to a stream client",
+                      stats.send_time);
+    metrics_histogram(out,
+                      "esp32cam_latency_microseconds",
+                      "Capture to the first byte written to a stream client",
+                      stats.latency);
+
+    metrics_header(out, "esp32cam_bytes_sent_total", "counter", "Frame bytes sent per server");
+    metrics_printf(out,
+                   "esp32cam_bytes_sent_total{server=\"stream\"} %llu\n"
+                   "esp32cam_bytes_sent_total{server=\"rtsp\"} %llu\n"
+                   "esp32cam_bytes_sent_total{server=\"multicast\"} %llu\n",
+                   static_cast<unsigned long long>(stats.bytes_sent.load()),
+                   static_cast<unsigned long long>(rtsp::bytes_sent()),
+                   static_cast<unsigned long long>(multicast::bytes_sent()));
+
+    metrics_header(out, "esp32cam_heap_free_bytes", "gauge", "Free heap");
+    metrics_printf(out,
+                   "esp32cam_heap_free_bytes{memory=\"internal\"} %zu\n"
+                   "esp32cam_heap_free_bytes{memory=\"psram\"} %zu\n",
+                   heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+                   heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    metrics_header(out,
+                   "esp32cam_heap_largest_free_block_bytes",
+                   "gauge",
+                   "Largest block that can be allocated");
+    metrics_printf(out,
+                   "esp32cam_heap_largest_free_block_bytes{memory=\"internal\"} %zu\n"
+                   "esp32cam_heap_largest_free_block_bytes{memory=\"psram\"} %zu\n",
+                   heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+                   heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+
+    if (WiFi.status() == WL_CONNECTED) {
+        metrics_header(out,
+                       "esp32cam_wifi_rssi_dbm",
+                       "gauge",
+                       "Signal strength of the access point");
+        metrics_printf(out, "esp32cam_wifi_rssi_dbm %d\n", WiFi.RSSI());
+    }
+
+#if configUSE_TRACE_FACILITY
+    metrics_header(out,
+                   "esp32cam_task_stack_high_water_bytes",
+                   "gauge",
+                   "Least stack left since the task started");
+    const UBaseType_t tasks = uxTaskGetSystemState(metrics_tasks, METRICS_MAX_TASKS, nullptr);
+    for (UBaseType_t i = 0; i < tasks; i++) {
+        // Names aren't unique (httpd, stream_client, ...), the task number is
+        metrics_printf(out,
+                       "esp32cam_task_stack_high_water_bytes{task=\"%s\",id=\"%u\"} %lu\n",
+                       metrics_tasks[i].pcTaskName,
+                       metrics_tasks[i].xTaskNumber,
+                       static_cast<unsigned long>(metrics_tasks[i].usStackHighWaterMark));
+    }
+#endif
+
+    metrics_header(out, "esp32cam_httpd_open_sockets", "gauge", "Open client sockets per server");
+    const std::pair<const char *, httpd_handle_t> servers[] = {
+      {"app", app_httpd},
+      {"stream", stream_httpd},
+    };
+    for (const auto &[name, server] : servers) {
+        if (!server) continue;
+        int    fds[CONFIG_LWIP_MAX_SOCKETS];
+        size_t count = CONFIG_LWIP_MAX_SOCKETS;
+        if (httpd_get_client_list(server, &count, fds) != ESP_OK) continue;
+        metrics_printf(out, "esp32cam_httpd_open_sockets{server=\"%s\"} %zu\n", name, count);
+    }
+
+    metrics_flush(out);
+    if (out.err != ESP_OK) return out.err;
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+static esp_err_t boot_handler(httpd_req_t *req) {
+    TRACE_SCOPE("boot_handler");
+    JsonDocument doc;
+    boot::to_json(doc);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return send_json(req, doc);
+}
+
+#if TRACE_ENABLED
+static esp_err_t trace_handler(httpd_req_t *req) {
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return trace::send_json(req);
+}
+#endif
+
 httpd_handle_t app_httpd = nullptr;
 
+/**
+ * @brief Start the bundle senders, without them the app server sends the bundles itself
+ */
+static void start_bundle_senders() {
+    bundle_queue = xQueueCreate(BUNDLE_SENDERS, sizeof(BundleJob_t));
+    // Given by each sender once started
+    bundle_idle = xSemaphoreCreateCounting(BUNDLE_SENDERS, 0);
+    if (!bundle_queue || !bundle_idle) {
+        log_e("Failed to create bundle queue");
+        blink_error<ERR_APP_SERVER>(ERR_APP_TASK, true);
+        if (bundle_queue) vQueueDelete(bundle_queue);
+        if (bundle_idle) vSemaphoreDelete(bundle_idle);
+        bundle_queue = nullptr;
+        bundle_idle  = nullptr;
+        return;
+    }
+    for (size_t i = 0; i < BUNDLE_SENDERS; i++) {
+        if (xTaskCreate(bundle_sender_fn,
+                        "bundle_sender",
+                        BUNDLE_SENDER_STACK_SIZE,
+                        nullptr,
+                        BUNDLE_SENDER_PRIORITY,
+                        nullptr) != pdPASS) {
+            log_e("Failed to start bundle sender %zu", i);
+            blink_error<ERR_APP_SERVER>(ERR_APP_TASK, true);
+            if (i == 0) {
+                vQueueDelete(bundle_queue);
+                vSemaphoreDelete(bundle_idle);
+                bundle_queue = nullptr;
+                bundle_idle  = nullptr;
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Start the capture worker, without it the app server waits for the frames itself
+ */
+static void start_capture_worker() {
+    capture_queue = xQueueCreate(CAPTURE_QUEUE_LEN, sizeof(httpd_req_t *));
+    if (!capture_queue) {
+        log_e("Failed to create capture queue");
+        blink_error<ERR_APP_SERVER>(ERR_APP_TASK, true);
+        return;
+    }
+    if (xTaskCreate(capture_worker_fn,
+                    "capture_worker",
+                    CAPTURE_WORKER_STACK_SIZE,
+                    nullptr,
+                    CAPTURE_WORKER_PRIORITY,
+                    nullptr) != pdPASS) {
+        log_e("Failed to start capture worker");
+        blink_error<ERR_APP_SERVER>(ERR_APP_TASK, true);
+        vQueueDelete(capture_queue);
+        capture_queue = nullptr;
+    }
+}
+
 void app::start() {
+    TRACE_SCOPE("app::start");
+    start_bundle_senders();
+    start_capture_worker();
+
     httpd_config_t config   = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 16;
+    config.max_uri_handlers = 18;
+    config.max_open_sockets = APP_MAX_OPEN_SOCKETS;
+    // A new client replaces the idlest one instead of being refused
+    config.lru_purge_enable = true;
 
     const httpd_uri_t index_uri = {
       .uri      = "/",
@@ -1062,6 +1751,80 @@ void app::start() {
 #endif
     };
 
+    const httpd_uri_t capture_uri = {
+      .uri      = "/capture",
+      .method   = HTTP_GET,
+      .handler  = capture_handler,
+      .user_ctx = reinterpret_cast<void *>(CAPTURE_JPEG),
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+      .is_websocket             = true,
+      .handle_ws_control_frames = false,
+      .supported_subprotocol    = nullptr,
+#endif
+    };
+
+    const httpd_uri_t capture_bmp_uri = {
+      .uri      = "/capture.bmp",
+      .method   = HTTP_GET,
+      .handler  = capture_handler,
+      .user_ctx = reinterpret_cast<void *>(CAPTURE_BMP),
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+      .is_websocket             = true,
+      .handle_ws_control_frames = false,
+      .supported_subprotocol    = nullptr,
+#endif
+    };
+
+    const httpd_uri_t capture_raw_uri = {
+      .uri      = "/capture.raw",
+      .method   = HTTP_GET,
+      .handler  = capture_handler,
+      .user_ctx = reinterpret_cast<void *>(CAPTURE_RAW),
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+      .is_websocket             = true,
+      .handle_ws_control_frames = false,
+      .supported_subprotocol    = nullptr,
+#endif
+    };
+
+    const httpd_uri_t metrics_uri = {
+      .uri      = "/metrics",
+      .method   = HTTP_GET,
+      .handler  = metrics_handler,
+      .user_ctx = nullptr,
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+      .is_websocket             = true,
+      .handle_ws_control_frames = false,
+      .supported_subprotocol    = nullptr,
+#endif
+    };
+
+    const httpd_uri_t boot_uri = {
+      .uri      = "/debug/boot",
+      .method   = HTTP_GET,
+      .handler  = boot_handler,
+      .user_ctx = nullptr,
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+      .is_websocket             = true,
+      .handle_ws_control_frames = false,
+      .supported_subprotocol    = nullptr,
+#endif
+    };
+
+#if TRACE_ENABLED
+    const httpd_uri_t trace_uri = {
+      .uri      = "/debug/trace",
+      .method   = HTTP_GET,
+      .handler  = trace_handler,
+      .user_ctx = nullptr,
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+      .is_websocket             = true,
+      .handle_ws_control_frames = false,
+      .supported_subprotocol    = nullptr,
+#endif
+    };
+#endif
+
     log_i("Starting App Server on port: '%d'", config.server_port);
     esp_err_t res = httpd_start(&app_httpd, &config);
     if (res == ESP_OK) {
@@ -1079,6 +1842,20 @@ void app::start() {
         if (res != ESP_OK) goto ota_register_uri_handler_failed;
         res = httpd_register_uri_handler(app_httpd, &sensor_post_uri);
         if (res != ESP_OK) goto ota_register_uri_handler_failed;
+        res = httpd_register_uri_handler(app_httpd, &capture_uri);
+        if (res != ESP_OK) goto ota_register_uri_handler_failed;
+        res = httpd_register_uri_handler(app_httpd, &capture_bmp_uri);
+        if (res != ESP_OK) goto ota_register_uri_handler_failed;
+        res = httpd_register_uri_handler(app_httpd, &capture_raw_uri);
+        if (res != ESP_OK) goto ota_register_uri_handler_failed;
+        res = httpd_register_uri_handler(app_httpd, &metrics_uri);
+        if (res != ESP_OK) goto ota_register_uri_handler_failed;
+        res = httpd_register_uri_handler(app_httpd, &boot_uri);
+        if (res != ESP_OK) goto ota_register_uri_handler_failed;
+#if TRACE_ENABLED
+        res = httpd_register_uri_handler(app_httpd, &trace_uri);
+        if (res != ESP_OK) goto ota_register_uri_handler_failed;
+#endif
 
         if (false) {
         ota_register_uri_handler_failed:
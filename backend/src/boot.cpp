@@ -0,0 +1,67 @@
+#include "boot.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <atomic>
+
+#include <esp_timer.h>
+
+#include <freertos/FreeRTOS.h>
+
+#include "config.hpp"
+
+struct BootStage_s {
+    const char *name  = nullptr;
+    int64_t     start = 0;
+    /// 0 while the stage runs
+    std::atomic<int64_t> end{0};
+    uint8_t              core = 0;
+    /// Set once the fields above are, the table is read while stages are added
+    std::atomic<bool> ready{false};
+};
+using BootStage_t = struct BootStage_s;
+
+static BootStage_t         boot_stages[BOOT_MAX_STAGES];
+static std::atomic<size_t> boot_count{0};
+
+int boot::begin(const char *name) {
+    const size_t slot = boot_count.fetch_add(1);
+    if (slot >= BOOT_MAX_STAGES) return -1;
+
+    BootStage_t &stage = boot_stages[slot];
+    stage.name         = name;
+    stage.core         = static_cast<uint8_t>(xPortGetCoreID());
+    stage.start        = esp_timer_get_time();
+    stage.ready.store(true, std::memory_order_release);
+    return static_cast<int>(slot);
+}
+
+void boot::end(const int slot) {
+    if (slot < 0) return;
+    // Never 0, an instant stage still reads as done
+    boot_stages[slot].end.store(std::max<int64_t>(esp_timer_get_time(), 1));
+}
+
+void boot::mark(const char *name) { end(begin(name)); }
+
+void boot::to_json(JsonDocument &doc) {
+    const size_t count = boot_count.load();
+    doc["dropped"]     = count > BOOT_MAX_STAGES ? count - BOOT_MAX_STAGES : 0;
+    doc["uptime"]      = esp_timer_get_time() / 1000.0;
+
+    JsonArray stages = doc["stages"].template to<JsonArray>();
+    for (size_t i = 0; i < count && i < BOOT_MAX_STAGES; i++) {
+        const BootStage_t &stage = boot_stages[i];
+        if (!stage.ready.load(std::memory_order_acquire)) continue;
+
+        JsonObject obj = stages.template add<JsonObject>();
+        obj["name"]    = stage.name;
+        obj["core"]    = stage.core;
+        obj["start"]   = stage.start / 1000.0;
+        // No `duration` while the stage runs
+        const int64_t end = stage.end.load();
+        if (end != 0) obj["duration"] = (end - stage.start) / 1000.0;
+    }
+}
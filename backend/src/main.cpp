@@ -2,12 +2,15 @@
 
 #include <cstring>
 
+#include <atomic>
 #include <tuple>
 #include <utility>
 
 #include <esp_log.h>
 #include <esp_camera.h>
 #include <esp_heap_caps.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
 
 #include "hw/camera.hpp"
 #include "types/camera.hpp"
@@ -24,13 +27,19 @@
 #include <StreamUtils.h>
 
 #include "bundle.h"
+#include "tools/bundle_image.hpp"
 #include "led.hpp"
 #include "stream.hpp"
+#include "rtsp.hpp"
+#include "multicast.hpp"
 #include "ota.hpp"
 #include "app.hpp"
+#include "boot.hpp"
+#include "trace.hpp"
 #include "error.hpp"
 
 inline void dump_camera_specs() {
+    BOOT_STAGE("dump_camera_specs");
     log_i("Board model: %s", camera_module_names[camera_module]);
     log_i("Camera pinout:");
     log_i("  PWDN:     %d", camera_pinout.pin_pwdn);
@@ -53,6 +62,7 @@ inline void dump_camera_specs() {
 }
 
 inline void setup_spiffs() {
+    BOOT_STAGE("setup_spiffs");
     if (!SPIFFS.begin()) {
         if constexpr (SPIFFS_FORMAT_IF_FAILED) {
             log_w("SPIFFS Mount Failed, formatting...");
@@ -72,6 +82,7 @@ inline void setup_spiffs() {
 }
 
 inline void setup_settings() {
+    BOOT_STAGE("setup_settings");
     if (!SPIFFS.exists(SPIFFS_SETTINGS_PATH)) {
         log_i("No settings file found");
         log_i("Creating default settings");
@@ -188,87 +199,119 @@ inline void setup_settings() {
     }
 }
 
-inline void setup_wifi() {
-    if (strlen(g_settings.wifi.sta.ssid) > 0) {
-        // There is a saved Wi-Fi configuration
-        log_i("Connecting to saved Wi-Fi: %s", g_settings.wifi.sta.ssid);
-
-        WiFi.setHostname(g_settings.wifi.hostname);
-        WiFi.setMinSecurity(g_settings.wifi.security);
-
-        if (!g_settings.wifi.sta.dhcp) {
-            log_i("Setting static IP address");
-            if (!WiFi.config(g_settings.wifi.sta.local_ip,
-                             g_settings.wifi.sta.gateway,
-                             g_settings.wifi.sta.subnet,
-                             g_settings.wifi.sta.dns1,
-                             g_settings.wifi.sta.dns2)) {
-                log_e("Failed to set static IP address");
-                blink_error<ERR_WIFI>(ERR_WIFI_STA_STATIC_IP, true);
-                if (!SPIFFS.remove(SPIFFS_SETTINGS_PATH)) {
-                    blink_error<ERR_SETTINGS>(ERR_SETTINGS_REMOVE, true);
-                }
-                ESP.restart();
-            }
-        } else {
-            log_i("Using DHCP");
-        }
+/**
+ * @brief Start the Wi-Fi portal, for when there is no usable saved Wi-Fi
+ */
+inline void setup_wifi_portal() {
+    BOOT_STAGE("setup_wifi_portal");
+    log_i("No saved Wi-Fi configuration or the saved Wi-Fi configuration is invalid");
+    log_i("Starting Wi-Fi Portal");
+
+    // Set Wi-Fi mode to AP
+    WiFi.setHostname(g_settings.wifi.hostname);
+    WiFi.softAPConfig(g_settings.wifi.ap.local_ip,
+                      g_settings.wifi.ap.gateway,
+                      g_settings.wifi.ap.subnet);
+    WiFi.softAP(g_settings.wifi.ap.ssid, g_settings.wifi.ap.pass);
+    WiFi.softAPenableIPv6();
+
+    log_n("Wi-Fi Portal Started!");
+    log_n("SSID:         %s", g_settings.wifi.ap.ssid);
+    log_n("Password:     %s", g_settings.wifi.ap.pass);
+    log_n("IPv4 Address: %s", WiFi.softAPIP().toString().c_str());
+    WiFi.onEvent(
+        [](WiFiEvent_t event, WiFiEventInfo_t info) {
+            log_n("IPv6 Address: [%s]", WiFi.softAPlinkLocalIPv6().toString().c_str());
+        },
+        WiFiEvent_t::ARDUINO_EVENT_WIFI_AP_GOT_IP6);
+}
+
+/**
+ * @brief Start connecting to the saved Wi-Fi, `setup_wifi_wait()` waits for it
+ *
+ * @return Whether it is connecting, otherwise the portal is already up
+ */
+inline bool setup_wifi_begin() {
+    BOOT_STAGE("setup_wifi_begin");
+    if (strlen(g_settings.wifi.sta.ssid) == 0) {
+        // There is no saved Wi-Fi configuration
+        setup_wifi_portal();
+        return false;
+    }
 
-        WiFi.begin(g_settings.wifi.sta.ssid, g_settings.wifi.sta.pass);
-        WiFi.enableIPv6();
-
-        const uint32_t tmr = millis();
-        while (!WiFi.isConnected()) {
-            delay(WIFI_RETRY_DELAY);
-            if (millis() - tmr > g_settings.wifi.timeout) {
-                log_i("");
-                log_i("Failed to connect to saved Wi-Fi");
-                log_i("Falling back to Wi-Fi Portal");
-                blink_error<ERR_WIFI>(ERR_WIFI_STA_CONNECT, true);
-                WiFi.disconnect(false, true);
-                break;
+    log_i("Connecting to saved Wi-Fi: %s", g_settings.wifi.sta.ssid);
+
+    WiFi.setHostname(g_settings.wifi.hostname);
+    WiFi.setMinSecurity(g_settings.wifi.security);
+
+    if (!g_settings.wifi.sta.dhcp) {
+        log_i("Setting static IP address");
+        if (!WiFi.config(g_settings.wifi.sta.local_ip,
+                         g_settings.wifi.sta.gateway,
+                         g_settings.wifi.sta.subnet,
+                         g_settings.wifi.sta.dns1,
+                         g_settings.wifi.sta.dns2)) {
+            log_e("Failed to set static IP address");
+            blink_error<ERR_WIFI>(ERR_WIFI_STA_STATIC_IP, true);
+            if (!SPIFFS.remove(SPIFFS_SETTINGS_PATH)) {
+                blink_error<ERR_SETTINGS>(ERR_SETTINGS_REMOVE, true);
             }
+            ESP.restart();
         }
+    } else {
+        log_i("Using DHCP");
+    }
 
-        if (WiFi.isConnected()) {
+    WiFi.onEvent(
+        [](WiFiEvent_t event, WiFiEventInfo_t info) {
+            // Only the first one belongs to the boot, not the reconnections
+            static std::atomic<bool> marked{false};
+            if (!marked.exchange(true)) boot::mark("wifi_got_ip");
+        },
+        WiFiEvent_t::ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    WiFi.begin(g_settings.wifi.sta.ssid, g_settings.wifi.sta.pass);
+    WiFi.enableIPv6();
+    return true;
+}
+
+/**
+ * @brief Wait for the connection `setup_wifi_begin()` started, the portal is the fallback
+ *
+ * @param started `millis()` when it started connecting, the timeout counts from there
+ */
+inline void setup_wifi_wait(const bool connecting, const uint32_t started) {
+    BOOT_STAGE("setup_wifi_wait");
+    if (!connecting) return;
+
+    while (!WiFi.isConnected()) {
+        delay(WIFI_RETRY_DELAY);
+        if (millis() - started > g_settings.wifi.timeout) {
             log_i("");
-            log_n("Wi-Fi Connected!");
-            log_n("IPv4 Address: %s", WiFi.localIP().toString().c_str());
-            WiFi.onEvent(
-                [](WiFiEvent_t event, WiFiEventInfo_t info) {
-                    log_n("IPv6 Address: [%s]", WiFi.linkLocalIPv6().toString().c_str());
-                },
-                WiFiEvent_t::ARDUINO_EVENT_WIFI_STA_GOT_IP6);
+            log_i("Failed to connect to saved Wi-Fi");
+            log_i("Falling back to Wi-Fi Portal");
+            blink_error<ERR_WIFI>(ERR_WIFI_STA_CONNECT, true);
+            WiFi.disconnect(false, true);
+            break;
         }
     }
 
-    if (!WiFi.isConnected() || g_settings.wifi.mode == WIFI_AP) {
-        // There is no saved Wi-Fi configuration
-        // or the saved Wi-Fi configuration is invalid
-        log_i("No saved Wi-Fi configuration or the saved Wi-Fi configuration is invalid");
-        log_i("Starting Wi-Fi Portal");
-
-        // Set Wi-Fi mode to AP
-        WiFi.setHostname(g_settings.wifi.hostname);
-        WiFi.softAPConfig(g_settings.wifi.ap.local_ip,
-                          g_settings.wifi.ap.gateway,
-                          g_settings.wifi.ap.subnet);
-        WiFi.softAP(g_settings.wifi.ap.ssid, g_settings.wifi.ap.pass);
-        WiFi.softAPenableIPv6();
-
-        log_n("Wi-Fi Portal Started!");
-        log_n("SSID:         %s", g_settings.wifi.ap.ssid);
-        log_n("Password:     %s", g_settings.wifi.ap.pass);
-        log_n("IPv4 Address: %s", WiFi.softAPIP().toString().c_str());
+    if (WiFi.isConnected()) {
+        log_i("");
+        log_n("Wi-Fi Connected!");
+        log_n("IPv4 Address: %s", WiFi.localIP().toString().c_str());
         WiFi.onEvent(
             [](WiFiEvent_t event, WiFiEventInfo_t info) {
-                log_n("IPv6 Address: [%s]", WiFi.softAPlinkLocalIPv6().toString().c_str());
+                log_n("IPv6 Address: [%s]", WiFi.linkLocalIPv6().toString().c_str());
             },
-            WiFiEvent_t::ARDUINO_EVENT_WIFI_AP_GOT_IP6);
+            WiFiEvent_t::ARDUINO_EVENT_WIFI_STA_GOT_IP6);
     }
+
+    // The saved Wi-Fi configuration is invalid, or the portal is wanted along with it
+    if (!WiFi.isConnected() || g_settings.wifi.mode == WIFI_AP) setup_wifi_portal();
 }
 
 inline camera_config_t init_camera_config() {
+    BOOT_STAGE("init_camera_config");
     return camera_config_t{
       .pin_pwdn  = camera_pinout.pin_pwdn,
       .pin_reset = camera_pinout.pin_reset,
@@ -308,6 +351,7 @@ inline camera_config_t init_camera_config() {
 }
 
 inline void prep_camera_module() {
+    BOOT_STAGE("prep_camera_module");
     switch (camera_module) {
         case ESP_EYE:
             pinMode(13, INPUT_PULLUP);
@@ -319,6 +363,7 @@ inline void prep_camera_module() {
 }
 
 inline void setup_camera_module(camera_config_t* camera_config) {
+    BOOT_STAGE("setup_camera_module");
     const esp_err_t err = esp_camera_init(camera_config);
     if (err != ESP_OK) {
         log_e("Camera initialization failed with error 0x%X", err);
@@ -332,6 +377,7 @@ inline void setup_camera_module(camera_config_t* camera_config) {
 }
 
 inline sensor_t* config_sensor() {
+    BOOT_STAGE("config_sensor");
     sensor_t* sensor = esp_camera_sensor_get();
     if (sensor == nullptr) {
         log_e("Failed to get camera sensor");
@@ -371,6 +417,7 @@ inline sensor_t* config_sensor() {
 }
 
 inline void setup_led() {
+    BOOT_STAGE("setup_led");
     if (camera_pinout.pin_led != -1) {
         led::setup(camera_pinout.pin_led);
         log_i("LED is on pin %d", camera_pinout.pin_led);
@@ -379,8 +426,115 @@ inline void setup_led() {
     }
 }
 
+/**
+ * @brief Map the bundle partition, the bundles are then served straight from flash
+ *
+ * @note Not being able to is not an error, the bundles it lacks come from SPIFFS
+ */
+inline void setup_bundle_partition() {
+    BOOT_STAGE("setup_bundle_partition");
+    const esp_partition_t* partition =
+        esp_partition_find_first(static_cast<esp_partition_type_t>(BUNDLE_PARTITION_TYPE),
+                                 ESP_PARTITION_SUBTYPE_ANY,
+                                 BUNDLE_PARTITION_LABEL);
+    if (partition == nullptr) {
+        log_i("No bundle partition");
+        return;
+    }
+
+    BundleHeader_t header;
+    esp_err_t      err = esp_partition_read(partition, 0, &header, sizeof(header));
+    if (err != ESP_OK) {
+        log_w("Failed to read bundle partition: %s", esp_err_to_name(err));
+        return;
+    }
+    if (const char* reason = bundle_header_check(header, partition->size)) {
+        log_w("Bundle partition not used: %s", reason);
+        return;
+    }
+
+    // Never unmapped, the handlers serve from it
+    const void*                 image = nullptr;
+    esp_partition_mmap_handle_t handle;
+    err = esp_partition_mmap(partition, 0, header.size, ESP_PARTITION_MMAP_DATA, &image, &handle);
+    if (err != ESP_OK) {
+        log_w("Failed to map bundle partition: %s", esp_err_to_name(err));
+        return;
+    }
+    log_d("Bundle partition mapped at %p, %zu bytes", image, static_cast<size_t>(header.size));
+
+    const auto base = static_cast<const uint8_t*>(image);
+    const auto map  = [&header, base](const char* name,
+                                     const uint8_t*& data,
+                                     size_t&         size,
+                                     uint32_t&       crc) {
+        const BundleEntry_t* entry = bundle_find(header, name);
+        if (entry == nullptr) return false;
+        data = base + entry->offset;
+        size = entry->size;
+        crc  = entry->crc32;
+        log_i("Bundle %s mapped, %zu bytes, CRC %08lx",
+              name,
+              static_cast<size_t>(entry->size),
+              static_cast<unsigned long>(entry->crc32));
+        return true;
+    };
+    // The Brotli variant only with its gzip one, so both are the same build
+    if (map(BUNDLE_INDEX_NAME,
+            index_full_html_gz,
+            index_full_html_gz_size,
+            index_full_html_gz_crc)) {
+        map(BUNDLE_INDEX_BR_NAME,
+            index_full_html_br,
+            index_full_html_br_size,
+            index_full_html_br_crc);
+    }
+    if (map(BUNDLE_API_NAME, api_full_html_gz, api_full_html_gz_size, api_full_html_gz_crc)) {
+        map(BUNDLE_API_BR_NAME, api_full_html_br, api_full_html_br_size, api_full_html_br_crc);
+    }
+}
+
+/**
+ * @brief Read an optional bundle from SPIFFS into PSRAM
+ *
+ * @return `false` if it is missing or couldn't be read, which is not an error
+ */
+inline bool load_optional_bundle(const char*     path,
+                                 const uint8_t*& data,
+                                 size_t&         size,
+                                 uint32_t&       crc) {
+    if (!SPIFFS.exists(path)) return false;
+    File bundle = SPIFFS.open(path, "r");
+    if (!bundle) {
+        log_w("Failed to open %s", path);
+        return false;
+    }
+
+    const size_t len = bundle.size();
+    const auto   buf =
+        reinterpret_cast<uint8_t*>(heap_caps_malloc(len, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM));
+    if (buf == nullptr || bundle.read(buf, len) != len) {
+        log_w("Failed to read %s", path);
+        heap_caps_free(buf);
+        return false;
+    }
+    bundle.close();
+
+    data = buf;
+    size = len;
+    crc  = esp_rom_crc32_le(0, buf, len);
+    log_i("Bundle %s loaded, %zu bytes", path, len);
+    return true;
+}
+
 inline void setup_frontend() {
-    if (SPIFFS.exists(SPIFFS_INDEX_BUNDLE_PATH)) {
+    BOOT_STAGE("setup_frontend");
+    if constexpr (BUNDLE_PARTITION_ENABLED) setup_bundle_partition();
+    // The Brotli variants are read along with gzip ones from SPIFFS, not mixed with mapped ones
+    const bool index_mapped = index_full_html_gz != nullptr;
+    const bool api_mapped   = api_full_html_gz != nullptr;
+
+    if (index_full_html_gz == nullptr && SPIFFS.exists(SPIFFS_INDEX_BUNDLE_PATH)) {
         File bundle = SPIFFS.open(SPIFFS_INDEX_BUNDLE_PATH, "r");
         if (!bundle) {
             log_e("Failed to open Index bundle");
@@ -393,9 +547,9 @@ inline void setup_frontend() {
         }
 
         index_full_html_gz_size = bundle.size();
-        index_full_html_gz      = reinterpret_cast<uint8_t*>(
+        auto gz = reinterpret_cast<uint8_t*>(
             heap_caps_malloc(index_full_html_gz_size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM));
-        if (index_full_html_gz == nullptr) {
+        if (gz == nullptr) {
             log_e("Failed to allocate memory for Index bundle");
 
             blink_error<ERR_FRONTEND>(ERR_FRONTEND_INDEX_ALLOC, true);
@@ -404,7 +558,7 @@ inline void setup_frontend() {
             }
             ESP.restart();
         }
-        size_t read = bundle.read(index_full_html_gz, index_full_html_gz_size);
+        size_t read = bundle.read(gz, index_full_html_gz_size);
         if (read != index_full_html_gz_size) {
             log_e("Failed to read Index bundle");
             log_i("Expected: %d, Actual: %d", index_full_html_gz_size, read);
@@ -416,13 +570,15 @@ inline void setup_frontend() {
             ESP.restart();
         }
         bundle.close();
+        index_full_html_gz     = gz;
+        index_full_html_gz_crc = esp_rom_crc32_le(0, gz, index_full_html_gz_size);
         log_d("Index bundle pointer: %p", index_full_html_gz);
         log_d("Index bundle size: %d", index_full_html_gz_size);
 
         log_i("Index bundle loaded");
     }
 
-    if (SPIFFS.exists(SPIFFS_API_BUNDLE_PATH)) {
+    if (api_full_html_gz == nullptr && SPIFFS.exists(SPIFFS_API_BUNDLE_PATH)) {
         File bundle = SPIFFS.open(SPIFFS_API_BUNDLE_PATH, "r");
         if (!bundle) {
             log_e("Failed to open API bundle");
@@ -435,9 +591,9 @@ inline void setup_frontend() {
         }
 
         api_full_html_gz_size = bundle.size();
-        api_full_html_gz      = reinterpret_cast<uint8_t*>(
+        auto gz = reinterpret_cast<uint8_t*>(
             heap_caps_malloc(api_full_html_gz_size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM));
-        if (api_full_html_gz == nullptr) {
+        if (gz == nullptr) {
             log_e("Failed to allocate memory for App bundle");
 
             blink_error<ERR_FRONTEND>(ERR_FRONTEND_APP_ALLOC, true);
@@ -446,7 +602,7 @@ inline void setup_frontend() {
             }
             ESP.restart();
         }
-        size_t read = bundle.read(api_full_html_gz, api_full_html_gz_size);
+        size_t read = bundle.read(gz, api_full_html_gz_size);
         if (read != api_full_html_gz_size) {
             log_e("Failed to read App bundle");
             log_i("Expected: %d, Actual: %d", api_full_html_gz_size, read);
@@ -458,17 +614,110 @@ inline void setup_frontend() {
             ESP.restart();
         }
         bundle.close();
+        api_full_html_gz     = gz;
+        api_full_html_gz_crc = esp_rom_crc32_le(0, gz, api_full_html_gz_size);
         log_d("API bundle pointer: %p", api_full_html_gz);
         log_d("API bundle size: %d", api_full_html_gz_size);
 
         log_i("API bundle loaded");
     }
+
+    if (!index_mapped && index_full_html_gz != nullptr) {
+        load_optional_bundle(SPIFFS_INDEX_BR_BUNDLE_PATH,
+                             index_full_html_br,
+                             index_full_html_br_size,
+                             index_full_html_br_crc);
+    }
+    if (!api_mapped && api_full_html_gz != nullptr) {
+        load_optional_bundle(SPIFFS_API_BR_BUNDLE_PATH,
+                             api_full_html_br,
+                             api_full_html_br_size,
+                             api_full_html_br_crc);
+    }
+}
+
+/// Given by the frontend task once the bundles are loaded
+static SemaphoreHandle_t frontend_loaded = nullptr;
+
+static void frontend_task_fn(void*) {
+    setup_frontend();
+    xSemaphoreGive(frontend_loaded);
+    vTaskDelete(nullptr);
+}
+
+/**
+ * @brief Load the frontend on core 0 while `setup()` brings the camera up on core 1
+ *
+ * @note Loaded right away if the task can't be started
+ */
+inline void setup_frontend_begin() {
+    frontend_loaded = xSemaphoreCreateBinary();
+    if (frontend_loaded != nullptr && xTaskCreatePinnedToCore(frontend_task_fn,
+                                                              "boot_frontend",
+                                                              BOOT_TASK_STACK_SIZE,
+                                                              nullptr,
+                                                              BOOT_TASK_PRIORITY,
+                                                              nullptr,
+                                                              0) == pdPASS) {
+        return;
+    }
+
+    log_w("Failed to start the frontend task, loading the frontend now");
+    if (frontend_loaded != nullptr) vSemaphoreDelete(frontend_loaded);
+    frontend_loaded = nullptr;
+    setup_frontend();
+}
+
+/**
+ * @brief Wait for `setup_frontend_begin()`, the App server can't start before
+ */
+inline void setup_frontend_wait() {
+    BOOT_STAGE("setup_frontend_wait");
+    if (frontend_loaded == nullptr) return;
+    xSemaphoreTake(frontend_loaded, portMAX_DELAY);
+    vSemaphoreDelete(frontend_loaded);
+    frontend_loaded = nullptr;
+}
+
+/**
+ * @brief Blink the LED to indicate a successful boot, then check the BOOT button
+ */
+static void boot_blink() {
+    pinMode(LED_TO_BLINK, OUTPUT);
+    for (int i = 0; i < 25; i++) {
+        digitalWrite(LED_TO_BLINK, LED_TO_BLINK_HIGH);
+        delay(50);
+        digitalWrite(LED_TO_BLINK, LED_TO_BLINK_LOW);
+        delay(50);
+    }
+
+    // Delete settings if BOOT button is pressed (Pull-up on GPIO0)
+    pinMode(GPIO_NUM_0, INPUT_PULLUP);
+    if (digitalRead(GPIO_NUM_0) == LOW) {
+        log_i("BOOT button pressed, deleting settings");
+        if (!SPIFFS.remove(SPIFFS_SETTINGS_PATH)) {
+            log_e("Failed to delete settings");
+            blink_error<ERR_SETTINGS>(ERR_SETTINGS_REMOVE, true);
+        } else {
+            log_i("Settings deleted");
+
+            ESP.restart();
+        }
+    }
+}
+
+static void boot_blink_task_fn(void*) {
+    boot_blink();
+    vTaskDelete(nullptr);
 }
 
 #pragma weak setup  // Make it weak to allow tests to override it
 void setup() {
-    // Sleep for a while to allow the serial monitor to start
-    sleep(1);
+    // First, so the other stages are traced
+    trace::start();
+
+    // Wait for the serial monitor, only worth it with the debug output
+    if constexpr (BOOT_SERIAL_WAIT > 0) delay(BOOT_SERIAL_WAIT);
 
     // Setup Serial
     Serial.begin(SERIAL_BAUD_RATE);
@@ -491,10 +740,17 @@ void setup() {
     setup_settings();
     log_i("Setup Settings. Done!");
 
+    // Wi-Fi associates and the frontend loads while the camera comes up
     log_i();
-    log_i("Setup Wi-Fi.");
-    setup_wifi();
-    log_i("Setup Wi-Fi. Done!");
+    log_i("Start Wi-Fi.");
+    const uint32_t wifi_started    = millis();
+    const bool     wifi_connecting = setup_wifi_begin();
+    log_i("Start Wi-Fi. Done!");
+
+    log_i();
+    log_i("Start loading frontend.");
+    setup_frontend_begin();
+    log_i("Start loading frontend. Done!");
 
     log_i();
     log_i("Init camera configuration.");
@@ -522,47 +778,68 @@ void setup() {
     setup_led();
     log_i("Initialize LED. Done!");
 
-    log_i();
-    log_i("Setup frontend");
-    setup_frontend();
-    log_i("Setup frontend. Done!");
-
+    // The servers listen on any address, they don't wait for Wi-Fi
     log_i();
     log_i("Start Stream server.");
-    stream::start();
+    {
+        const boot::Stage stage("stream::start");
+        stream::start();
+    }
     log_i("Start Stream server. Done!");
 
     log_i();
-    log_i("Start OTA server.");
-    ota::start();
-    log_i("Start OTA server. Done!");
+    log_i("Start RTSP server.");
+    {
+        const boot::Stage stage("rtsp::start");
+        rtsp::start();
+    }
+    log_i("Start RTSP server. Done!");
+
+    log_i();
+    log_i("Wait for frontend.");
+    setup_frontend_wait();
+    log_i("Wait for frontend. Done!");
 
     log_i();
     log_i("Start App server.");
-    app::start();
+    {
+        const boot::Stage stage("app::start");
+        app::start();
+    }
     log_i("Start App server. Done!");
 
-    // Blink LED to indicate successful boot
-    pinMode(LED_TO_BLINK, OUTPUT);
-    for (int i = 0; i < 25; i++) {
-        digitalWrite(LED_TO_BLINK, LED_TO_BLINK_HIGH);
-        delay(50);
-        digitalWrite(LED_TO_BLINK, LED_TO_BLINK_LOW);
-        delay(50);
+    log_i();
+    log_i("Start OTA handlers.");
+    {
+        const boot::Stage stage("ota::start");
+        ota::start();
     }
+    log_i("Start OTA handlers. Done!");
 
-    // Delete settings if BOOT button is pressed (Pull-up on GPIO0)
-    pinMode(GPIO_NUM_0, INPUT_PULLUP);
-    if (digitalRead(GPIO_NUM_0) == LOW) {
-        log_i("BOOT button pressed, deleting settings");
-        if (!SPIFFS.remove(SPIFFS_SETTINGS_PATH)) {
-            log_e("Failed to delete settings");
-            blink_error<ERR_SETTINGS>(ERR_SETTINGS_REMOVE, true);
-        } else {
-            log_i("Settings deleted");
+    log_i();
+    log_i("Wait for Wi-Fi.");
+    setup_wifi_wait(wifi_connecting, wifi_started);
+    log_i("Wait for Wi-Fi. Done!");
 
-            ESP.restart();
-        }
+    log_i();
+    log_i("Start multicast stream.");
+    {
+        const boot::Stage stage("multicast::start");
+        multicast::start();
+    }
+    log_i("Start multicast stream. Done!");
+
+    boot::mark("setup_done");
+
+    // Don't hold `setup()` for the 2.5 s of blinking
+    if (xTaskCreate(boot_blink_task_fn,
+                    "boot_blink",
+                    BOOT_TASK_STACK_SIZE,
+                    nullptr,
+                    BOOT_TASK_PRIORITY,
+                    nullptr) != pdPASS) {
+        log_w("Failed to start the blink task, blinking now");
+        boot_blink();
     }
 }
 
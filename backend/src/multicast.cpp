@@ -0,0 +1,188 @@
+#include "multicast.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+
+#include <esp_log.h>
+
+#include <lwip/sockets.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "stream.hpp"
+#include "trace.hpp"
+#include "config.hpp"
+
+#include "error.hpp"
+
+/// How long the task waits for a frame before trying again (ms)
+static constexpr uint32_t MULTICAST_POLL_INTERVAL = 1000;
+/// Times a datagram is retried while lwIP is out of buffers
+static constexpr int MULTICAST_SEND_RETRIES = 5;
+
+/// The datagram carries the XOR of all the data fragments of the frame
+static constexpr uint8_t MULTICAST_FLAG_PARITY = 1 << 0;
+
+/**
+ * @brief Header in front of every datagram, little-endian
+ *
+ * A frame is `count` data fragments of `MULTICAST_PAYLOAD_SIZE` bytes, the last one shorter,
+ * followed by a parity fragment with `index == count` if FEC is enabled. The parity payload
+ * is the XOR of all the data fragments zero-padded to `MULTICAST_PAYLOAD_SIZE`, so a receiver
+ * missing exactly one data fragment of the frame can rebuild it.
+ */
+struct __attribute__((packed)) MulticastHeader_s {
+    /// Frame sequence number, gaps mean dropped frames
+    uint32_t seq;
+    uint16_t index;
+    /// Number of data fragments, without the parity one
+    uint16_t count;
+    uint32_t frame_len;
+    /// Capture timestamp in us
+    uint64_t timestamp;
+    uint16_t width;
+    uint16_t height;
+    uint8_t  flags;
+};
+using MulticastHeader_t = struct MulticastHeader_s;
+
+static constexpr size_t MULTICAST_PAYLOAD_SIZE = MULTICAST_PACKET_SIZE - sizeof(MulticastHeader_t);
+
+static int         sock = -1;
+static sockaddr_in group_addr{};
+/// Parity of the frame being sent
+static uint8_t parity[MULTICAST_PAYLOAD_SIZE];
+
+/// Datagram bytes sent, headers included
+static std::atomic<uint64_t> bytes_sent{0};
+
+static bool send_datagram(const MulticastHeader_t &header, const uint8_t *payload, size_t len) {
+    iovec iov[] = {
+      {const_cast<MulticastHeader_t *>(&header), sizeof(header)},
+      {const_cast<uint8_t *>(payload), len},
+    };
+    msghdr msg{};
+    msg.msg_name    = &group_addr;
+    msg.msg_namelen = sizeof(group_addr);
+    msg.msg_iov     = iov;
+    msg.msg_iovlen  = 2;
+
+    for (int retry = 0; retry < MULTICAST_SEND_RETRIES; retry++) {
+        if (sendmsg(sock, &msg, 0) >= 0) {
+            bytes_sent += sizeof(header) + len;
+            return true;
+        }
+        if (errno != ENOMEM) {
+            log_w("Failed to send multicast datagram, errno: %d", errno);
+            return false;
+        }
+        // Out of network buffers, let the Wi-Fi driver drain them
+        vTaskDelay(1);
+    }
+    // Drop the datagram, the parity fragment or the next frame covers it
+    return true;
+}
+
+/**
+ * @brief Send the frame as fragments, straight from the frame buffer
+ */
+static void send_frame(const stream::FrameInfo_t *frame, const bool fec) {
+    const size_t      count  = (frame->len + MULTICAST_PAYLOAD_SIZE - 1) / MULTICAST_PAYLOAD_SIZE;
+    MulticastHeader_t header = {
+      .seq       = frame->seq,
+      .index     = 0,
+      .count     = static_cast<uint16_t>(count),
+      .frame_len = static_cast<uint32_t>(frame->len),
+      .timestamp = static_cast<uint64_t>(frame->timestamp.tv_sec) * 1000000 +
+                   frame->timestamp.tv_usec,
+      .width  = static_cast<uint16_t>(frame->width),
+      .height = static_cast<uint16_t>(frame->height),
+      .flags  = 0,
+    };
+
+    if (fec) memset(parity, 0, sizeof(parity));
+    for (size_t offset = 0; offset < frame->len; offset += MULTICAST_PAYLOAD_SIZE) {
+        const size_t   len     = std::min(MULTICAST_PAYLOAD_SIZE, frame->len - offset);
+        const uint8_t *payload = frame->buf + offset;
+        if (fec) {
+            for (size_t i = 0; i < len; i++) parity[i] ^= payload[i];
+        }
+        if (!send_datagram(header, payload, len)) return;
+        header.index++;
+    }
+
+    if (fec) {
+        header.flags = MULTICAST_FLAG_PARITY;
+        send_datagram(header, parity, count > 1 ? MULTICAST_PAYLOAD_SIZE : frame->len);
+    }
+}
+
+static void multicast_task(void *) {
+    const MulticastSettings_t &settings   = g_settings.multicast;
+    stream::Subscriber_t       subscriber = -1;
+
+    while (true) {
+        if (subscriber < 0) {
+            subscriber = stream::subscribe(settings.max_fps);
+            if (subscriber < 0) {
+                // Every client slot is taken, wait for one to free up
+                vTaskDelay(pdMS_TO_TICKS(MULTICAST_POLL_INTERVAL));
+                continue;
+            }
+        }
+
+        const stream::FrameInfo_t *frame =
+            stream::next(subscriber, pdMS_TO_TICKS(MULTICAST_POLL_INTERVAL));
+        if (!frame) continue;
+        send_frame(frame, settings.fec);
+        stream::release(subscriber, frame);
+    }
+}
+
+uint64_t multicast::bytes_sent() {
+    return ::bytes_sent;
+}
+
+void multicast::start() {
+    TRACE_SCOPE("multicast::start");
+    const MulticastSettings_t &settings = g_settings.multicast;
+    if (!settings.enabled) {
+        log_i("Multicast stream disabled");
+        return;
+    }
+
+    log_i("Starting multicast stream to: '%s:%d'",
+          settings.group.toString().c_str(),
+          settings.port);
+
+    group_addr.sin_family      = AF_INET;
+    group_addr.sin_addr.s_addr = static_cast<uint32_t>(settings.group);
+    group_addr.sin_port        = htons(settings.port);
+
+    const uint8_t ttl  = settings.ttl;
+    const uint8_t loop = 0;
+    sock               = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0 || setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0) {
+        log_e("Failed to open multicast socket, errno: %d", errno);
+        blink_error<ERR_STREAM_SERVER>(ERR_STREAM_MULTICAST, true);
+        if (sock >= 0) close(sock);
+        sock = -1;
+        return;
+    }
+
+    if (xTaskCreate(multicast_task,
+                    "multicast",
+                    MULTICAST_TASK_STACK_SIZE,
+                    nullptr,
+                    MULTICAST_TASK_PRIORITY,
+                    nullptr) != pdPASS) {
+        log_e("Failed to start multicast task");
+        blink_error<ERR_STREAM_SERVER>(ERR_STREAM_TASK, true);
+    }
+}
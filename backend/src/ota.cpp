@@ -8,6 +8,7 @@
 #include "error.hpp"
 
 #include "config.hpp"
+#include "trace.hpp"
 
 static constexpr const char OTA_INDEX[] =
     R"(<!DOCTYPE html>
@@ -36,6 +37,7 @@ static constexpr const char OTA_SUCCESS[] =
     "<META http-equiv=\"refresh\" content=\"15;URL=/\">Update Success! Rebooting...";
 
 static esp_err_t update_handler(httpd_req_t* req) {
+    TRACE_SCOPE("update_handler");
     esp_err_t ret = ESP_OK;
 
     switch (req->method) {
@@ -136,14 +138,15 @@ static esp_err_t update_handler(httpd_req_t* req) {
     return ret;
 }
 
-httpd_handle_t ota_httpd = nullptr;
+extern httpd_handle_t app_httpd;
 
 void ota::start() {
-    httpd_config_t config   = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 8;
-    config.task_priority   -= 1;
-    config.server_port      = 3232;
-    config.ctrl_port        = 3233;
+    TRACE_SCOPE("ota::start");
+    if (!app_httpd) {
+        log_e("App server isn't running, OTA isn't served");
+        blink_error<ERR_OTA_SERVER>(ERR_OTA_START, true);
+        return;
+    }
 
     const httpd_uri_t update_get_uri = {
       .uri      = g_settings.ota.path.c_str(),
@@ -169,22 +172,16 @@ void ota::start() {
 #endif
     };
 
-    log_i("Starting OTA server on port: '%d'", config.server_port);
-    esp_err_t res = httpd_start(&ota_httpd, &config);
-    if (res == ESP_OK) {
-        res = httpd_register_uri_handler(ota_httpd, &update_get_uri);
-        if (res != ESP_OK) goto ota_register_uri_handler_failed;
+    log_i("Serving OTA on the app server at: '%s'", g_settings.ota.path.c_str());
+    esp_err_t res = httpd_register_uri_handler(app_httpd, &update_get_uri);
+    if (res != ESP_OK) goto ota_register_uri_handler_failed;
 
-        res = httpd_register_uri_handler(ota_httpd, &update_post_uri);
-        if (res != ESP_OK) goto ota_register_uri_handler_failed;
+    res = httpd_register_uri_handler(app_httpd, &update_post_uri);
+    if (res != ESP_OK) goto ota_register_uri_handler_failed;
 
-        if (false) {
-        ota_register_uri_handler_failed:
-            log_e("Failed to register URI handler, err: %d", res);
-            blink_error<ERR_OTA_SERVER>(ERR_OTA_REG_URI, true);
-        }
-    } else {
-        log_e("Failed to start OTA Server, err: %d", res);
-        blink_error<ERR_OTA_SERVER>(ERR_OTA_START, true);
+    if (false) {
+    ota_register_uri_handler_failed:
+        log_e("Failed to register URI handler, err: %d", res);
+        blink_error<ERR_OTA_SERVER>(ERR_OTA_REG_URI, true);
     }
 }
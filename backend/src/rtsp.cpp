@@ -0,0 +1,626 @@
+#include "rtsp.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+
+#include <lwip/sockets.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "tools/rtp_jpeg.hpp"
+#include "tools/send_all.hpp"
+#include "stream.hpp"
+#include "trace.hpp"
+#include "config.hpp"
+
+#include "error.hpp"
+
+static constexpr const char RTSP_PUBLIC[] =
+    "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER\r\n";
+static constexpr const char RTSP_SDP[] = "v=0\r\n"
+                                         "o=- %lu 1 IN IP4 %s\r\n"
+                                         "s=%s\r\n"
+                                         "c=IN IP4 0.0.0.0\r\n"
+                                         "t=0 0\r\n"
+                                         "m=video 0 RTP/AVP 26\r\n"
+                                         "a=control:track0\r\n";
+
+/// How long a playing session waits for a frame before looking at requests again (ms)
+static constexpr uint32_t RTSP_POLL_INTERVAL = 20;
+/// How long an idle session waits for a request (ms)
+static constexpr uint32_t RTSP_IDLE_INTERVAL = 1000;
+/// Times a UDP packet is retried while lwIP is out of buffers
+static constexpr int RTP_SEND_RETRIES = 5;
+
+/// RTP bytes written by all the sessions, headers included
+static std::atomic<uint64_t> bytes_sent{0};
+
+// =============================
+// Sessions
+// =============================
+
+#pragma region
+
+struct Session_s {
+    /// RTSP connection
+    int      fd   = -1;
+    uint32_t id   = 0;
+    uint32_t ssrc = 0;
+    uint16_t seq  = 0;
+
+    /// RTP goes over the RTSP connection instead of UDP
+    bool    interleaved = false;
+    uint8_t channel     = 0;
+
+    int         rtp_fd  = -1;
+    int         rtcp_fd = -1;
+    sockaddr_in rtp_addr{};
+
+    /// Frames come from the stream while playing
+    stream::Subscriber_t subscriber = -1;
+    /// Last request or RTCP packet from the client
+    int64_t last_seen = 0;
+
+    char   request[RTSP_REQUEST_SIZE];
+    size_t request_len = 0;
+
+    /// Slot is taken (until the session task exits)
+    std::atomic<bool> in_use{false};
+};
+using Session_t = struct Session_s;
+
+static Session_t sessions[RTSP_MAX_SESSIONS];
+
+static Session_t *session_claim() {
+    for (auto &session : sessions) {
+        bool expected = false;
+        if (session.in_use.compare_exchange_strong(expected, true)) return &session;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Value of a request header, `nullptr` if missing
+ *
+ * @param len Set to the length of the value
+ */
+static const char *header_value(const char *request, const char *name, size_t &len) {
+    const size_t name_len = strlen(name);
+    for (const char *line = strstr(request, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+        const char *value = line + 2;
+        if (strncasecmp(value, name, name_len) != 0 || value[name_len] != ':') continue;
+        value += name_len + 1;
+        while (*value == ' ') value++;
+        const char *end = strstr(value, "\r\n");
+        len             = end ? end - value : strlen(value);
+        return value;
+    }
+    return nullptr;
+}
+
+static bool respond(Session_t  *session,
+                    int         cseq,
+                    const char *status,
+                    const char *headers = "",
+                    const char *body    = nullptr) {
+    char         head[512];
+    const size_t body_len = body ? strlen(body) : 0;
+
+    int len = snprintf(head, sizeof(head), "RTSP/1.0 %s\r\nCSeq: %d\r\n%s", status, cseq, headers);
+    if (body && len > 0 && len < sizeof(head)) {
+        len += snprintf(head + len, sizeof(head) - len, "Content-Length: %zu\r\n", body_len);
+    }
+    if (len > 0 && len < sizeof(head)) {
+        len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    }
+    if (len <= 0 || len >= sizeof(head)) {
+        log_e("RTSP response doesn't fit into %zuB", sizeof(head));
+        return false;
+    }
+
+    iovec iov[] = {
+      {head, static_cast<size_t>(len)},
+      {const_cast<char *>(body), body_len},
+    };
+    return send_all(session->fd, iov, body ? 2 : 1) == ESP_OK;
+}
+
+#pragma endregion
+
+// =============================
+// RTP
+// =============================
+
+#pragma region
+
+static bool send_udp(Session_t     *session,
+                     const uint8_t *header,
+                     size_t         header_len,
+                     const uint8_t *payload,
+                     size_t         payload_len) {
+    iovec iov[] = {
+      {const_cast<uint8_t *>(header), header_len},
+      {const_cast<uint8_t *>(payload), payload_len},
+    };
+    msghdr msg{};
+    msg.msg_name    = &session->rtp_addr;
+    msg.msg_namelen = sizeof(session->rtp_addr);
+    msg.msg_iov     = iov;
+    msg.msg_iovlen  = 2;
+
+    for (int retry = 0; retry < RTP_SEND_RETRIES; retry++) {
+        if (sendmsg(session->rtp_fd, &msg, 0) >= 0) return true;
+        if (errno != ENOMEM) {
+            log_w("Failed to send RTP packet, errno: %d", errno);
+            return false;
+        }
+        // Out of network buffers, let the Wi-Fi driver drain them
+        vTaskDelay(1);
+    }
+    // Drop the packet, the receiver conceals the missing part of the frame
+    return true;
+}
+
+/**
+ * @brief Send the RTP packet over the RTSP connection, see RFC 2326 10.12
+ */
+static bool send_interleaved(Session_t     *session,
+                             const uint8_t *header,
+                             size_t         header_len,
+                             const uint8_t *payload,
+                             size_t         payload_len) {
+    uint8_t      prefix[4 + RTP_JPEG_MAX_HEADERS];
+    const size_t packet_len = header_len + payload_len;
+
+    prefix[0] = '$';
+    prefix[1] = session->channel;
+    prefix[2] = packet_len >> 8;
+    prefix[3] = packet_len;
+    memcpy(prefix + 4, header, header_len);
+
+    iovec iov[] = {
+      {prefix, 4 + header_len},
+      {const_cast<uint8_t *>(payload), payload_len},
+    };
+    return send_all(session->fd, iov, 2) == ESP_OK;
+}
+
+/**
+ * @brief Packetize the JPEG per RFC 2435 and send it
+ *
+ * @return `false` if the session should be closed
+ */
+static bool send_frame(Session_t *session, const stream::FrameInfo_t *frame) {
+    RtpJpegFrame_t jpeg{};
+    if (!rtp_jpeg_parse(frame->buf, frame->len, jpeg)) {
+        log_w("Frame %lu can't be sent over RTP", frame->seq);
+        return true;
+    }
+
+    const uint64_t timestamp_us =
+        static_cast<uint64_t>(frame->timestamp.tv_sec) * 1000000 + frame->timestamp.tv_usec;
+    const uint32_t timestamp = timestamp_us * (RTP_JPEG_CLOCK_RATE / 1000) / 1000;
+
+    return rtp_jpeg_packetize(jpeg,
+                              session->seq,
+                              timestamp,
+                              session->ssrc,
+                              RTP_MAX_PACKET_SIZE,
+                              [session](const uint8_t *header,
+                                        size_t         header_len,
+                                        const uint8_t *payload,
+                                        size_t         payload_len) {
+                                  const bool sent =
+                                      session->interleaved
+                                          ? send_interleaved(
+                                                session, header, header_len, payload, payload_len)
+                                          : send_udp(
+                                                session, header, header_len, payload, payload_len);
+                                  if (sent) bytes_sent += header_len + payload_len;
+                                  return sent;
+                              });
+}
+
+/**
+ * @brief Open the RTP and RTCP sockets of the session
+ */
+static bool open_udp(Session_t *session) {
+    const uint16_t port = RTSP_RTP_PORT + 2 * (session - sessions);
+
+    int *fds[] = {&session->rtp_fd, &session->rtcp_fd};
+    for (size_t i = 0; i < 2; i++) {
+        if (*fds[i] >= 0) continue;
+        const int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (fd < 0) return false;
+
+        sockaddr_in addr{};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port        = htons(port + i);
+        if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            return false;
+        }
+        *fds[i] = fd;
+    }
+    return true;
+}
+
+#pragma endregion
+
+// =============================
+// Requests
+// =============================
+
+#pragma region
+
+static bool handle_describe(Session_t *session, int cseq, const char *url) {
+    sockaddr_in local{};
+    socklen_t   local_len = sizeof(local);
+    char        ip[INET_ADDRSTRLEN]{};
+    if (getsockname(session->fd, reinterpret_cast<sockaddr *>(&local), &local_len) == 0) {
+        inet_ntop(AF_INET, &local.sin_addr, ip, sizeof(ip));
+    }
+
+    char sdp[sizeof(RTSP_SDP) + 10 + INET_ADDRSTRLEN + WIFI_HOST_SIZE];
+    snprintf(sdp, sizeof(sdp), RTSP_SDP, session->id, ip, g_settings.wifi.hostname);
+
+    char headers[RTSP_REQUEST_SIZE / 2];
+    snprintf(headers,
+             sizeof(headers),
+             "Content-Base: %s/\r\n"
+             "Content-Type: application/sdp\r\n",
+             url);
+    return respond(session, cseq, "200 OK", headers, sdp);
+}
+
+static bool handle_setup(Session_t *session, int cseq, const char *request) {
+    size_t      value_len = 0;
+    const char *value     = header_value(request, "Transport", value_len);
+    if (!value) return respond(session, cseq, "461 Unsupported Transport");
+
+    char transport[128];
+    strlcpy(transport, value, std::min(value_len + 1, sizeof(transport)));
+
+    char headers[256];
+    if (strstr(transport, "RTP/AVP/TCP")) {
+        int         rtp = 0, rtcp = 1;
+        const char *interleaved = strstr(transport, "interleaved=");
+        if (interleaved) sscanf(interleaved, "interleaved=%d-%d", &rtp, &rtcp);
+
+        session->interleaved = true;
+        session->channel     = rtp;
+        snprintf(headers,
+                 sizeof(headers),
+                 "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d;ssrc=%08lX\r\n"
+                 "Session: %08lX;timeout=%lu\r\n",
+                 rtp,
+                 rtcp,
+                 session->ssrc,
+                 session->id,
+                 RTSP_SESSION_TIMEOUT);
+        return respond(session, cseq, "200 OK", headers);
+    }
+
+    int         rtp = 0, rtcp = 0;
+    const char *client_port = strstr(transport, "client_port=");
+    if (strstr(transport, "multicast") || !client_port ||
+        sscanf(client_port, "client_port=%d-%d", &rtp, &rtcp) != 2) {
+        return respond(session, cseq, "461 Unsupported Transport");
+    }
+
+    socklen_t addr_len = sizeof(session->rtp_addr);
+    if (getpeername(session->fd, reinterpret_cast<sockaddr *>(&session->rtp_addr), &addr_len) !=
+            0 ||
+        !open_udp(session)) {
+        log_e("Failed to open RTP sockets");
+        return respond(session, cseq, "500 Internal Server Error");
+    }
+    session->rtp_addr.sin_port = htons(rtp);
+    session->interleaved       = false;
+
+    const uint16_t port = RTSP_RTP_PORT + 2 * (session - sessions);
+    snprintf(headers,
+             sizeof(headers),
+             "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%u-%u;ssrc=%08lX\r\n"
+             "Session: %08lX;timeout=%lu\r\n",
+             rtp,
+             rtcp,
+             port,
+             port + 1,
+             session->ssrc,
+             session->id,
+             RTSP_SESSION_TIMEOUT);
+    return respond(session, cseq, "200 OK", headers);
+}
+
+static bool handle_play(Session_t *session, int cseq) {
+    if (!session->interleaved && session->rtp_fd < 0) {
+        return respond(session, cseq, "455 Method Not Valid in This State");
+    }
+    if (session->subscriber < 0) {
+        session->subscriber = stream::subscribe(0);
+        if (session->subscriber < 0) return respond(session, cseq, "453 Not Enough Bandwidth");
+    }
+
+    char headers[64];
+    snprintf(headers, sizeof(headers), "Session: %08lX\r\nRange: npt=0.000-\r\n", session->id);
+    return respond(session, cseq, "200 OK", headers);
+}
+
+static bool handle_pause(Session_t *session, int cseq) {
+    if (session->subscriber >= 0) {
+        stream::unsubscribe(session->subscriber);
+        session->subscriber = -1;
+    }
+
+    char headers[32];
+    snprintf(headers, sizeof(headers), "Session: %08lX\r\n", session->id);
+    return respond(session, cseq, "200 OK", headers);
+}
+
+/**
+ * @brief Handle one request, NUL-terminated after its headers
+ *
+ * @return `false` if the session should be closed
+ */
+static bool handle_request(Session_t *session, const char *request) {
+    char method[16];
+    char url[256];
+    if (sscanf(request, "%15s %255s RTSP/1.0", method, url) != 2) {
+        log_w("Malformed RTSP request");
+        respond(session, 0, "400 Bad Request");
+        return false;
+    }
+
+    size_t      value_len = 0;
+    const char *value     = header_value(request, "CSeq", value_len);
+    const int   cseq      = value ? atoi(value) : 0;
+
+    log_d("RTSP: %s %s", method, url);
+    if (strcmp(method, "OPTIONS") == 0) {
+        return respond(session, cseq, "200 OK", RTSP_PUBLIC);
+    } else if (strcmp(method, "DESCRIBE") == 0) {
+        return handle_describe(session, cseq, url);
+    } else if (strcmp(method, "SETUP") == 0) {
+        return handle_setup(session, cseq, request);
+    } else if (strcmp(method, "PLAY") == 0) {
+        return handle_play(session, cseq);
+    } else if (strcmp(method, "PAUSE") == 0) {
+        return handle_pause(session, cseq);
+    } else if (strcmp(method, "TEARDOWN") == 0) {
+        respond(session, cseq, "200 OK");
+        return false;
+    } else if (strcmp(method, "GET_PARAMETER") == 0 || strcmp(method, "SET_PARAMETER") == 0) {
+        // Keep-alive
+        return respond(session, cseq, "200 OK");
+    }
+    return respond(session, cseq, "501 Not Implemented");
+}
+
+static void consume(Session_t *session, size_t len) {
+    session->request_len -= len;
+    memmove(session->request, session->request + len, session->request_len);
+}
+
+/**
+ * @brief Handle every complete request in the buffer
+ *
+ * @return `false` if the session should be closed
+ */
+static bool handle_requests(Session_t *session) {
+    while (session->request_len > 0) {
+        char *request = session->request;
+
+        // RTCP from the client when interleaved
+        if (request[0] == '$') {
+            if (session->request_len < 4) return true;
+            const size_t packet_len =
+                4 + (static_cast<uint8_t>(request[2]) << 8 | static_cast<uint8_t>(request[3]));
+            if (packet_len > sizeof(session->request) - 1) return false;
+            if (session->request_len < packet_len) return true;
+            consume(session, packet_len);
+            continue;
+        }
+
+        request[session->request_len] = '\0';
+        char *end                      = strstr(request, "\r\n\r\n");
+        if (!end) {
+            if (session->request_len < sizeof(session->request) - 1) return true;
+            log_w("RTSP request doesn't fit into %zuB", sizeof(session->request));
+            return false;
+        }
+        end[2] = '\0';
+
+        size_t       value_len   = 0;
+        const char  *value       = header_value(request, "Content-Length", value_len);
+        const size_t request_len = end + 4 - request + (value ? atoi(value) : 0);
+        if (request_len > sizeof(session->request) - 1) return false;
+        if (request_len > session->request_len) {
+            // Body is still on the way
+            end[2] = '\r';
+            return true;
+        }
+
+        if (!handle_request(session, request)) return false;
+        consume(session, request_len);
+    }
+    return true;
+}
+
+/**
+ * @brief Wait up to `timeout` ms for requests or RTCP and handle them
+ *
+ * @return `false` if the session should be closed
+ */
+static bool poll_requests(Session_t *session, uint32_t timeout) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(session->fd, &fds);
+    if (session->rtcp_fd >= 0) FD_SET(session->rtcp_fd, &fds);
+
+    timeval tv{
+      .tv_sec  = static_cast<time_t>(timeout / 1000),
+      .tv_usec = static_cast<suseconds_t>(timeout % 1000 * 1000),
+    };
+    const int max_fd = std::max(session->fd, session->rtcp_fd);
+    const int ready  = select(max_fd + 1, &fds, nullptr, nullptr, &tv);
+    if (ready < 0) return false;
+    if (ready == 0) return true;
+
+    if (session->rtcp_fd >= 0 && FD_ISSET(session->rtcp_fd, &fds)) {
+        // Receiver reports only tell that the client is still there
+        uint8_t report[128];
+        recv(session->rtcp_fd, report, sizeof(report), MSG_DONTWAIT);
+        session->last_seen = esp_timer_get_time();
+    }
+    if (!FD_ISSET(session->fd, &fds)) return true;
+
+    const ssize_t received = recv(session->fd,
+                                  session->request + session->request_len,
+                                  sizeof(session->request) - 1 - session->request_len,
+                                  0);
+    if (received <= 0) return false;
+    session->request_len += received;
+    session->last_seen    = esp_timer_get_time();
+
+    return handle_requests(session);
+}
+
+#pragma endregion
+
+// =============================
+// Tasks
+// =============================
+
+#pragma region
+
+static void session_task(void *arg) {
+    auto *session = static_cast<Session_t *>(arg);
+
+    while (true) {
+        const bool playing = session->subscriber >= 0;
+        if (!poll_requests(session, playing ? 0 : RTSP_IDLE_INTERVAL)) break;
+        if (esp_timer_get_time() - session->last_seen > RTSP_SESSION_TIMEOUT * 1000000LL) {
+            log_i("RTSP session %08lX timed out", session->id);
+            break;
+        }
+        if (session->subscriber < 0) continue;
+
+        const stream::FrameInfo_t *frame =
+            stream::next(session->subscriber, pdMS_TO_TICKS(RTSP_POLL_INTERVAL));
+        if (!frame) continue;
+        const bool sent = send_frame(session, frame);
+        stream::release(session->subscriber, frame);
+        if (!sent) break;
+    }
+
+    if (session->subscriber >= 0) stream::unsubscribe(session->subscriber);
+    if (session->rtp_fd >= 0) close(session->rtp_fd);
+    if (session->rtcp_fd >= 0) close(session->rtcp_fd);
+    close(session->fd);
+    log_i("RTSP session %08lX closed", session->id);
+
+    session->fd         = -1;
+    session->rtp_fd     = -1;
+    session->rtcp_fd    = -1;
+    session->subscriber = -1;
+    session->in_use     = false;
+    vTaskDelete(nullptr);
+}
+
+static void server_task(void *) {
+    const int listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(RTSP_PORT);
+
+    const int reuse = 1;
+    if (listen_fd < 0 ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        listen(listen_fd, RTSP_MAX_SESSIONS) != 0) {
+        log_e("Failed to listen on RTSP port, errno: %d", errno);
+        blink_error<ERR_RTSP_SERVER>(ERR_RTSP_START, true);
+        if (listen_fd >= 0) close(listen_fd);
+        vTaskDelete(nullptr);
+        return;
+    }
+
+    while (true) {
+        // Connections wait in the backlog, without a socket, until a session ends
+        Session_t *session = session_claim();
+        if (!session) {
+            vTaskDelay(pdMS_TO_TICKS(RTSP_POLL_INTERVAL));
+            continue;
+        }
+
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            log_w("Failed to accept RTSP connection, errno: %d", errno);
+            session->in_use = false;
+            vTaskDelay(pdMS_TO_TICKS(RTSP_POLL_INTERVAL));
+            continue;
+        }
+
+        const timeval send_timeout{.tv_sec = 5, .tv_usec = 0};
+        const int     no_delay = 1;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        session->fd          = fd;
+        session->id          = esp_random();
+        session->ssrc        = esp_random();
+        session->seq         = esp_random();
+        session->interleaved = false;
+        session->channel     = 0;
+        session->request_len = 0;
+        session->last_seen   = esp_timer_get_time();
+
+        if (xTaskCreate(session_task,
+                        "rtsp_session",
+                        RTSP_TASK_STACK_SIZE,
+                        session,
+                        RTSP_TASK_PRIORITY,
+                        nullptr) != pdPASS) {
+            log_e("Failed to start RTSP session task");
+            blink_error<ERR_RTSP_SERVER>(ERR_RTSP_TASK, true);
+            close(fd);
+            session->fd     = -1;
+            session->in_use = false;
+        }
+    }
+}
+
+#pragma endregion
+
+uint64_t rtsp::bytes_sent() {
+    return ::bytes_sent;
+}
+
+void rtsp::start() {
+    TRACE_SCOPE("rtsp::start");
+    log_i("Starting RTSP Server on port: '%d'", RTSP_PORT);
+    if (xTaskCreate(server_task,
+                    "rtsp_server",
+                    RTSP_TASK_STACK_SIZE,
+                    nullptr,
+                    RTSP_TASK_PRIORITY,
+                    nullptr) != pdPASS) {
+        log_e("Failed to start RTSP Server task");
+        blink_error<ERR_RTSP_SERVER>(ERR_RTSP_TASK, true);
+    }
+}
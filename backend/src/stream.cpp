@@ -3,142 +3,1592 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <utility>
 
 #include <esp_log.h>
 #include <esp_timer.h>
 #include <esp_http_server.h>
+#include <esp_heap_caps.h>
 #include <img_converters.h>
 
+#include <lwip/sockets.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "tools/buffer_pool.hpp"
+#include "tools/part_header.hpp"
+#include "tools/send_all.hpp"
 #include "tools/ra_filter.hpp"
+#include "tools/histogram.hpp"
 #include "led.hpp"
+#include "boot.hpp"
+#include "trace.hpp"
 #include "types/camera.hpp"
+#include "config.hpp"
+#include "json.hpp"
 
 #include "error.hpp"
 
 #define PART_BOUNDARY "TotallyRandomBoundaryString123"
 
-static constexpr const char STREAM_CONTENT_TYPE[] =
-    "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
-static constexpr const char STREAM_BOUNDARY[]    = "\r\n--" PART_BOUNDARY "\r\n";
-static constexpr const char STREAM_PART[]        = "Content-Type: image/jpeg\r\n"
-                                                   "Content-Length: %zu\r\n"
-                                                   "X-Timestamp: %ld.%06ld\r\n"
-                                                   "X-Framerate: %.1f\r\n"
-                                                   "X-Average-Framerate: %.1f\r\n\r\n";
-static constexpr size_t     STREAM_PART_FULL_LEN = sizeof(STREAM_PART) * 1.5f;
+// Written straight to the socket in front of the first frame
+static constexpr const char STREAM_RESPONSE[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=" PART_BOUNDARY "\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n";
+static constexpr const char META_RESPONSE[] = "HTTP/1.1 200 OK\r\n"
+                                              "Content-Type: text/event-stream\r\n"
+                                              "Cache-Control: no-cache\r\n"
+                                              "Access-Control-Allow-Origin: *\r\n"
+                                              "Transfer-Encoding: chunked\r\n"
+                                              "\r\n";
+/// One Server-Sent Event per frame, the event id is the sequence number
+static constexpr const char META_EVENT[] =
+    "id: %lu\n"
+    R"(data: {"seq":%lu,"timestamp":%lld,"latency":%lld,"size":%zu,"width":%zu,"height":%zu,)"
+    R"("exposure":%u,"gain":%u})"
+    "\n\n";
+static constexpr const char STREAM_BOUNDARY[]  = "\r\n--" PART_BOUNDARY "\r\n";
+static constexpr const char STREAM_CHUNK_END[] = "\r\n";
+/// Room for the chunk size line ("%x\r\n") in front of the boundary
+static constexpr size_t STREAM_CHUNK_HEADROOM = sizeof(size_t) * 2 + 2;
 
 static constexpr uint8_t FRAME2JPG_QUALITY = 80;
 
-static esp_err_t stream_handler(httpd_req_t *req) {
-    esp_err_t    ret = ESP_OK;
-    camera_fb_t *fb  = nullptr;
-    timeval      timestamp{};
-    uint8_t     *buf     = nullptr;
-    size_t       buf_len = 0;
-    char        *part_buf[STREAM_PART_FULL_LEN];
-
-    int64_t  last_frame     = 0;
+/// Encoder quality, lowered by the adaptive quality controller
+static std::atomic<uint8_t> encode_quality{FRAME2JPG_QUALITY};
+
+// =============================
+// Frames
+// =============================
+
+#pragma region
+
+/**
+ * @brief Frame shared between all stream clients
+ *
+ * @note Captured once by the capture task, the buffer is given back
+ *       (to the camera driver or to the heap) by the last holder
+ */
+struct Frame_s : stream::FrameInfo_s {
+    /// Camera frame buffer owning `buf`, `nullptr` if the frame was re-encoded or detached
+    camera_fb_t *fb = nullptr;
+    /// Number of holders, the slot is free when zero
+    std::atomic<uint32_t> refs{0};
+};
+using Frame_t = struct Frame_s;
+
+static Frame_t              frames[STREAM_MAX_FRAMES];
+static std::atomic<uint32_t> held_fbs{0};
+static std::atomic<uint32_t> frame_seq{0};
+/// Waits for a camera frame buffer to come back while the clients hold all of them
+static TaskHandle_t capture_task = nullptr;
+
+static stream::Stats_t stream_stats{};
+/// When the previous frame was published, for `stream_stats.frame_time`
+static int64_t         last_publish = 0;
+
+static BufferPool<STREAM_ENCODE_POOL_SIZE> encode_pool{};
+/// Raw frames dropped because every encode buffer was taken
+static std::atomic<uint32_t> encode_pool_exhausted{0};
+/// Raw frames dropped because the JPEG didn't fit into an encode buffer
+static std::atomic<uint32_t> encode_overflow{0};
+
+static int64_t timestamp_us(const timeval &timestamp) {
+    return static_cast<int64_t>(timestamp.tv_sec) * 1000000 + timestamp.tv_usec;
+}
+
+static Frame_t *frame_alloc() {
+    for (auto &frame : frames) {
+        uint32_t expected = 0;
+        if (frame.refs.compare_exchange_strong(expected, 1)) {
+            frame.seq = frame_seq++;
+            return &frame;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Copy what the clients report about the frame buffer and the sensor state
+ *
+ * @note The camera driver timestamps frame buffers with `esp_timer_get_time`
+ */
+static void frame_describe(Frame_t *frame, const camera_fb_t *fb) {
+    frame->timestamp.tv_sec  = fb->timestamp.tv_sec;
+    frame->timestamp.tv_usec = fb->timestamp.tv_usec;
+    frame->width             = fb->width;
+    frame->height            = fb->height;
+
+    const sensor_t *s = esp_camera_sensor_get();
+    frame->exposure   = s ? s->status.aec_value : 0;
+    frame->gain       = s ? s->status.agc_gain : 0;
+}
+
+static Frame_t *frame_acquire(Frame_t *frame) {
+    frame->refs.fetch_add(1);
+    return frame;
+}
+
+static void frame_release(Frame_t *frame) {
+    uint32_t refs = frame->refs.load();
+    while (true) {
+        if (refs == 1) {
+            // Last holder, nobody else can acquire it anymore
+            if (frame->fb) {
+                esp_camera_fb_return(frame->fb);
+                held_fbs--;
+                xTaskNotifyGive(capture_task);
+            } else if (frame->buf && !encode_pool.release(frame->buf)) {
+                free(frame->buf);
+            }
+            frame->fb  = nullptr;
+            frame->buf = nullptr;
+            frame->len = 0;
+            frame->refs.store(0);
+            return;
+        }
+        if (frame->refs.compare_exchange_weak(refs, refs - 1)) return;
+    }
+}
+
+/**
+ * @brief Copy the frame out of the camera frame buffer and give it back
+ *
+ * @note Keeps the driver capturing while a slow client still holds the frame
+ *       and the others are due for the next one
+ */
+static bool frame_detach(Frame_t *frame) {
+    auto *buf = static_cast<uint8_t *>(
+        heap_caps_malloc(frame->len, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM));
+    if (!buf) return false;
+    memcpy(buf, frame->buf, frame->len);
+    esp_camera_fb_return(frame->fb);
+    held_fbs--;
+    frame->fb  = nullptr;
+    frame->buf = buf;
+    return true;
+}
+
+#pragma endregion
+
+// =============================
+// Clients
+// =============================
+
+#pragma region
+
+enum ClientKind_e {
+    /// `/stream`, multipart over chunked HTTP
+    CLIENT_MJPEG,
+    /// `/ws/stream`, one binary WebSocket message per frame
+    CLIENT_WS,
+    /// `/stream/meta`, one Server-Sent Event per frame, without the JPEG
+    CLIENT_META,
+    /// `stream::subscribe`, frames are pulled by the caller instead of a client task
+    CLIENT_SUBSCRIBER,
+};
+using ClientKind_t = enum ClientKind_e;
+
+struct Client_s {
+    ClientKind_t kind = CLIENT_MJPEG;
+    /// Asynchronous copy of the HTTP request, `nullptr` for WebSocket clients
+    httpd_req_t *req = nullptr;
+    int          fd  = -1;
+    /// Peer address, for the stats
+    char addr[INET6_ADDRSTRLEN] = {};
+    /// Frames handed over by the capture task, `nullptr` tells the client to stop
+    QueueHandle_t queue = nullptr;
+    TaskHandle_t  task  = nullptr;
+    /// Held by the client task while it writes, the server closes the socket only in between
+    SemaphoreHandle_t send_lock = nullptr;
+    /// Slot is taken (until every holder let go of it)
+    std::atomic<bool> in_use{false};
+    /// Client task, plus the WebSocket session for WebSocket clients
+    std::atomic<uint8_t> holders{0};
+    /// Client receives frames (until the capture task drops it)
+    std::atomic<bool> active{false};
+    /// Sending failed, waiting for the capture task to drop it
+    std::atomic<bool> failed{false};
+    /// Client holds a frame, set by the capture task and cleared by the client
+    std::atomic<bool> busy{false};
+
+    /// Payload of the PING to answer, written by the session only while no PONG is pending
+    uint8_t           ws_ping[125] = {};
+    size_t            ws_ping_len  = 0;
+    std::atomic<bool> ws_pong_pending{false};
+    std::atomic<bool> ws_close_pending{false};
+    /// A wake-up is queued, the client task clears it before answering
+    std::atomic<bool> ws_wake_pending{false};
+
+    /// Minimum time between frames in us, 0 means every frame
+    std::atomic<int64_t> interval{0};
+    /// Deadline of the next frame, frames captured before it are not offered
+    std::atomic<int64_t> next_due{0};
+
+    /// Frames sent to the client
+    std::atomic<uint32_t> sent{0};
+    /// Frames skipped because the client was still busy with an older one
+    std::atomic<uint32_t> dropped{0};
+    /// Payload bytes sent to the client
+    std::atomic<uint64_t> bytes{0};
+    /// Smoothed send rate in B/s, measured from how long frames take to write
+    std::atomic<uint32_t> throughput{0};
+};
+using Client_t = struct Client_s;
+
+/// Queued to wake a WebSocket client task up for a pending PONG or CLOSE
+static Frame_t ws_wakeup{};
+
+static Client_t            clients[STREAM_MAX_CLIENTS];
+static std::atomic<size_t> active_clients{0};
+static SemaphoreHandle_t   clients_lock = nullptr;
+static TaskHandle_t        encode_task  = nullptr;
+static QueueHandle_t       encode_queue = nullptr;
+static esp_timer_handle_t  pace_timer   = nullptr;
+
+extern httpd_handle_t stream_httpd;
+
+/**
+ * @brief Send one multipart part as a single chunk with one write
+ *
+ * @note Chunk size line, boundary and part header are laid out back to back in
+ *       `part_buf`, the JPEG is gathered from the frame buffer as is
+ */
+static esp_err_t send_frame(int            fd,
+                            bool           first,
+                            const Frame_t *frame,
+                            int64_t        frame_time,
+                            uint32_t       avg_frame_time) {
+    TRACE_SCOPE("send_frame");
+    const PartHeader_t header = {
+      .content_length    = frame->len,
+      .timestamp_sec     = frame->timestamp.tv_sec,
+      .timestamp_usec    = static_cast<uint32_t>(frame->timestamp.tv_usec),
+      .frame_time_ms     = frame_time,
+      .avg_frame_time_ms = avg_frame_time,
+      .seq               = frame->seq,
+      .latency_us        = esp_timer_get_time() - timestamp_us(frame->timestamp),
+      .exposure          = frame->exposure,
+      .gain              = frame->gain,
+    };
+
+    char  part_buf[STREAM_CHUNK_HEADROOM + sizeof(STREAM_BOUNDARY) - 1 + PART_HEADER_SIZE];
+    char *part = part_buf + STREAM_CHUNK_HEADROOM;
+
+    memcpy(part, STREAM_BOUNDARY, sizeof(STREAM_BOUNDARY) - 1);
+    size_t part_len  = sizeof(STREAM_BOUNDARY) - 1;
+    part_len        += part_header_build(part + part_len, header);
+
+    // Fill the headroom backwards with the chunk size line
+    char   size_line[STREAM_CHUNK_HEADROOM];
+    size_t size_len       = part_header_put_hex(size_line, part_len + frame->len);
+    size_line[size_len++] = '\r';
+    size_line[size_len++] = '\n';
+    part                 -= size_len;
+    memcpy(part, size_line, size_len);
+    part_len += size_len;
+
+    iovec iov[] = {
+      {const_cast<char *>(STREAM_RESPONSE), sizeof(STREAM_RESPONSE) - 1},
+      {part, part_len},
+      {frame->buf, frame->len},
+      {const_cast<char *>(STREAM_CHUNK_END), sizeof(STREAM_CHUNK_END) - 1},
+    };
+    if (first) return send_all(fd, iov, 4);
+    return send_all(fd, iov + 1, 3);
+}
+
+/// Binary header in front of every JPEG on `/ws/stream`, little-endian
+struct __attribute__((packed)) WsFrameHeader_s {
+    /// Capture timestamp in us
+    uint64_t timestamp;
+    uint32_t seq;
+    uint16_t width;
+    uint16_t height;
+};
+using WsFrameHeader_t = struct WsFrameHeader_s;
+
+/**
+ * @brief Send the frame as one binary WebSocket message with one write
+ *
+ * @note Server messages aren't masked, so the WebSocket frame header and
+ *       `WsFrameHeader_t` go out in one small buffer in front of the JPEG
+ */
+static esp_err_t send_ws_frame(int fd, const Frame_t *frame) {
+    TRACE_SCOPE("send_ws_frame");
+    const WsFrameHeader_t header = {
+      .timestamp = static_cast<uint64_t>(frame->timestamp.tv_sec) * 1000000 +
+                   frame->timestamp.tv_usec,
+      .seq    = frame->seq,
+      .width  = static_cast<uint16_t>(frame->width),
+      .height = static_cast<uint16_t>(frame->height),
+    };
+    const uint64_t payload_len = sizeof(header) + frame->len;
+
+    uint8_t head[2 + sizeof(uint64_t) + sizeof(header)];
+    size_t  head_len = 0;
+    head[head_len++] = 0x80 | HTTPD_WS_TYPE_BINARY;  // FIN
+    if (payload_len < 126) {
+        head[head_len++] = payload_len;
+    } else if (payload_len <= UINT16_MAX) {
+        head[head_len++] = 126;
+        head[head_len++] = payload_len >> 8;
+        head[head_len++] = payload_len;
+    } else {
+        head[head_len++] = 127;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            head[head_len++] = payload_len >> shift;
+        }
+    }
+    memcpy(head + head_len, &header, sizeof(header));
+    head_len += sizeof(header);
+
+    iovec iov[] = {
+      {head, head_len},
+      {frame->buf, frame->len},
+    };
+    return send_all(fd, iov, 2);
+}
+
+/**
+ * @brief Send a PONG or a CLOSE, from the client task only like the frames
+ */
+static esp_err_t send_ws_control(int fd, httpd_ws_type_t type, uint8_t *payload, size_t len) {
+    uint8_t head[2] = {static_cast<uint8_t>(0x80 | type), static_cast<uint8_t>(len)};  // FIN
+    iovec   iov[]   = {
+      {head, sizeof(head)},
+      {payload, len},
+    };
+    return send_all(fd, iov, len > 0 ? 2 : 1);
+}
+
+/**
+ * @brief Answer the PING and CLOSE the session handed over
+ *
+ * @note httpd leaves control frames of `/ws/stream` to its handler, so that the
+ *       client task stays the only one writing to the socket
+ */
+static void ws_answer(Client_t *client, const int fd) {
+    if (client->ws_pong_pending.load(std::memory_order_acquire)) {
+        if (!client->failed &&
+            send_ws_control(fd, HTTPD_WS_TYPE_PONG, client->ws_ping, client->ws_ping_len) !=
+                ESP_OK) {
+            client->failed = true;
+        }
+        client->ws_pong_pending.store(false, std::memory_order_release);
+    }
+    if (client->ws_close_pending.exchange(false)) {
+        if (!client->failed) send_ws_control(fd, HTTPD_WS_TYPE_CLOSE, nullptr, 0);
+        client->failed = true;
+        httpd_sess_trigger_close(stream_httpd, fd);
+        xTaskNotifyGive(capture_task);
+    }
+}
+
+/**
+ * @brief Send the frame metadata as one Server-Sent Event in a single chunk
+ */
+static esp_err_t send_meta(int fd, bool first, const Frame_t *frame) {
+    TRACE_SCOPE("send_meta");
+    char  event_buf[STREAM_CHUNK_HEADROOM + sizeof(META_EVENT) + 8 * 20];
+    char *event = event_buf + STREAM_CHUNK_HEADROOM;
+
+    size_t event_len = snprintf(event,
+                                sizeof(event_buf) - STREAM_CHUNK_HEADROOM,
+                                META_EVENT,
+                                static_cast<unsigned long>(frame->seq),
+                                static_cast<unsigned long>(frame->seq),
+                                timestamp_us(frame->timestamp),
+                                esp_timer_get_time() - timestamp_us(frame->timestamp),
+                                frame->len,
+                                frame->width,
+                                frame->height,
+                                frame->exposure,
+                                frame->gain);
+
+    char   size_line[STREAM_CHUNK_HEADROOM];
+    size_t size_len       = part_header_put_hex(size_line, event_len);
+    size_line[size_len++] = '\r';
+    size_line[size_len++] = '\n';
+    event                -= size_len;
+    memcpy(event, size_line, size_len);
+    event_len += size_len;
+
+    iovec iov[] = {
+      {const_cast<char *>(META_RESPONSE), sizeof(META_RESPONSE) - 1},
+      {event, event_len},
+      {const_cast<char *>(STREAM_CHUNK_END), sizeof(STREAM_CHUNK_END) - 1},
+    };
+    if (first) return send_all(fd, iov, 3);
+    return send_all(fd, iov + 1, 2);
+}
+
+static void client_reset(Client_t *client) {
+    client->kind             = CLIENT_MJPEG;
+    client->req              = nullptr;
+    client->fd               = -1;
+    client->queue            = nullptr;
+    client->task             = nullptr;
+    client->failed           = false;
+    client->busy             = false;
+    client->ws_ping_len      = 0;
+    client->ws_pong_pending  = false;
+    client->ws_close_pending = false;
+    client->ws_wake_pending  = false;
+    client->interval         = 0;
+    client->next_due         = 0;
+    client->sent             = 0;
+    client->dropped          = 0;
+    client->bytes            = 0;
+    client->throughput       = 0;
+    client->in_use           = false;
+}
+
+/**
+ * @brief Let go of the slot, the last holder frees it
+ */
+static void client_put(Client_t *client) {
+    if (--client->holders == 0) client_reset(client);
+}
+
+static void client_task(void *arg) {
+    auto     *client = static_cast<Client_t *>(arg);
+    const int fd     = client->fd;
+    Frame_t  *frame  = nullptr;
+
+    int64_t  last_frame     = esp_timer_get_time();
     int64_t  frame_time     = 0;
     uint32_t avg_frame_time = 0;
 
     RaFilter ra_filter{};
 
-    ret = httpd_resp_set_type(req, STREAM_CONTENT_TYPE);
-    if (ret != ESP_OK) {
-        log_e("Failed to set content type, err: %d", ret);
-        blink_error<ERR_STREAM_SERVER>(ERR_STREAM_SET_CT, true);
-        return ret;
+    while (xQueueReceive(client->queue, &frame, portMAX_DELAY) == pdTRUE && frame) {
+        if (frame == &ws_wakeup) client->ws_wake_pending = false;
+        xSemaphoreTake(client->send_lock, portMAX_DELAY);
+        if (client->kind == CLIENT_WS) ws_answer(client, fd);
+        if (frame == &ws_wakeup) {
+            xSemaphoreGive(client->send_lock);
+            continue;
+        }
+        if (!client->failed) {
+            const int64_t send_start = esp_timer_get_time();
+            if (client->kind != CLIENT_META) {
+                stream_stats.latency.record(send_start - timestamp_us(frame->timestamp));
+            }
+            esp_err_t     ret        = ESP_OK;
+            switch (client->kind) {
+                case CLIENT_WS:
+                    ret = send_ws_frame(fd, frame);
+                    break;
+                case CLIENT_META:
+                    ret = send_meta(fd, client->sent == 0, frame);
+                    break;
+                default:
+                    ret = send_frame(fd, client->sent == 0, frame, frame_time, avg_frame_time);
+                    break;
+            }
+            if (ret != ESP_OK) {
+                log_w("Failed to send the frame, err: %d", ret);
+                client->failed = true;
+                if (client->kind == CLIENT_WS) httpd_sess_trigger_close(stream_httpd, fd);
+                xTaskNotifyGive(capture_task);
+            } else if (client->kind == CLIENT_META) {
+                // Says nothing about the link, keep it out of the adaptive quality
+                client->sent++;
+            } else {
+                client->sent++;
+                client->bytes += frame->len;
+                stream_stats.sent++;
+                stream_stats.bytes_sent += frame->len;
+
+                const int64_t  now        = esp_timer_get_time();
+                const int64_t  send_time  = std::max<int64_t>(now - send_start, 1);
+                stream_stats.send_time.record(send_time);
+                const uint64_t sample     = frame->len * 1000000ULL / send_time;
+                const uint32_t throughput = client->throughput;
+                client->throughput =
+                    std::min<uint64_t>(throughput ? (3ULL * throughput + sample) / 4 : sample,
+                                       UINT32_MAX);
+
+                frame_time        = (now - last_frame) / 1000;
+                last_frame        = now;
+                avg_frame_time    = ra_filter(static_cast<int32_t>(frame_time));
+                log_i("%s: %luB %lldms (%.1ffps), AVG: %lums (%.1ffps)",
+                      client->kind == CLIENT_WS ? "WS" : "MJPG",
+                      frame->len,
+                      frame_time,
+                      1000.f / frame_time,
+                      avg_frame_time,
+                      1000.f / avg_frame_time);
+            }
+        }
+        xSemaphoreGive(client->send_lock);
+        frame_release(frame);
+        client->busy = false;
+        // Due again, the capture task may be sleeping until then
+        xTaskNotifyGive(capture_task);
     }
 
-    ret = httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-    if (ret != ESP_OK) {
-        log_e("Failed to set Access-Control-Allow-Origin, err: %d", ret);
-        blink_error<ERR_STREAM_SERVER>(ERR_STREAM_SET_HDR, true);
-        return ret;
+    // Dropped by the capture task, only a WebSocket session could still wake it up
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    vQueueDelete(client->queue);
+    client->queue = nullptr;
+    xSemaphoreGive(clients_lock);
+    if (client->req) {
+        httpd_req_async_handler_complete(client->req);
+        client->req = nullptr;
     }
 
-    led::enable(true);
+    client->task = nullptr;
+    client_put(client);
+    vTaskDelete(nullptr);
+}
+
+/**
+ * @brief Hand the frame over to every idle client that is due for one
+ *
+ * @note Latest frame wins: a client still sending an older frame skips this one
+ *       instead of queueing it, so a slow viewer never holds more than one frame
+ *
+ * @note Paced clients get their next deadline one interval after the previous
+ *       one, so the average rate holds even if frames come in late
+ *
+ * @note Called by the capture and encode tasks only, also drops the failed clients
+ */
+static void publish(Frame_t *frame) {
+    TRACE_SCOPE("publish");
+    const int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    if (frame) {
+        if (last_publish) stream_stats.frame_time.record(now - last_publish);
+        last_publish = now;
+        stream_stats.frame_size.record(frame->len);
+    }
+    for (auto &client : clients) {
+        if (!client.active) continue;
+        if (client.failed) {
+            Frame_t *stop = nullptr;
+            xQueueSend(client.queue, &stop, portMAX_DELAY);
+            client.active = false;
+            if (--active_clients == 0) {
+                led::enable(false);
+            }
+            continue;
+        }
+        if (frame) {
+            if (now < client.next_due) continue;
+            if (client.busy.exchange(true)) {
+                client.dropped++;
+                stream_stats.dropped++;
+                continue;
+            }
+            if (client.interval > 0) {
+                const int64_t next = client.next_due + client.interval;
+                client.next_due    = next > now ? next : now + client.interval;
+            }
+            frame_acquire(frame);
+            if (xQueueSend(client.queue, &frame, 0) != pdTRUE) {
+                frame_release(frame);
+                client.busy = false;
+                client.dropped++;
+                stream_stats.dropped++;
+            }
+        }
+    }
+    xSemaphoreGive(clients_lock);
+}
+
+/**
+ * @brief Minimum time between frames for the requested rate, capped by `stream.max_fps`
+ *
+ * @param fps Requested rate, 0 or less means no request, raised to `STREAM_MIN_FPS`
+ */
+static int64_t frame_interval(const float fps) {
+    float limit = g_settings.stream.max_fps;
+    if (fps > 0 && (limit == 0 || fps < limit)) limit = std::max(fps, STREAM_MIN_FPS);
+    return limit > 0 ? static_cast<int64_t>(1000000 / limit) : 0;
+}
+
+/**
+ * @brief Take a free client slot
+ *
+ * @note Called with `clients_lock` held
+ */
+static Client_t *client_claim() {
+    for (auto &slot : clients) {
+        if (!slot.in_use) return &slot;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Start the client task and let the capture task hand it frames
+ *
+ * @note Called with `clients_lock` held
+ */
+static bool client_start(Client_t *client, const int fd) {
+    client->fd = fd;
+    {
+        sockaddr_in6 addr{};
+        socklen_t    addr_len = sizeof(addr);
+        if (getpeername(fd, reinterpret_cast<sockaddr *>(&addr), &addr_len) == 0) {
+            inet_ntop(AF_INET6, &addr.sin6_addr, client->addr, sizeof(client->addr));
+        }
+    }
+    // A frame, a WebSocket wake-up and the stop
+    client->queue = xQueueCreate(3, sizeof(Frame_t *));
+    if (!client->queue || (client->kind != CLIENT_SUBSCRIBER &&
+                           xTaskCreate(client_task,
+                                       "stream_client",
+                                       STREAM_TASK_STACK_SIZE,
+                                       client,
+                                       STREAM_TASK_PRIORITY,
+                                       &client->task) != pdPASS)) {
+        log_e("Failed to start stream client task");
+        blink_error<ERR_STREAM_SERVER>(ERR_STREAM_TASK, true);
+        if (client->queue) {
+            vQueueDelete(client->queue);
+            client->queue = nullptr;
+        }
+        client->fd = -1;
+        return false;
+    }
+    client->in_use = true;
+    client->active = true;
+    if (active_clients++ == 0) {
+        led::enable(true);
+    }
+    return true;
+}
+
+/**
+ * @brief Earliest deadline among the active clients, `INT64_MAX` if there are none
+ *
+ * @note Busy clients can't take a frame, they notify the capture task once done
+ */
+static int64_t next_capture_due() {
+    int64_t due = INT64_MAX;
+    for (auto &client : clients) {
+        if (!client.active || client.failed || client.busy) continue;
+        due = std::min<int64_t>(due, client.next_due);
+    }
+    return due;
+}
+
+static void pace_timer_cb(void *) {
+    xTaskNotifyGive(capture_task);
+}
+
+#pragma endregion
+
+// =============================
+// Adaptive quality
+// =============================
+
+#pragma region
+
+struct Adapt_s {
+    /// Start of the current measurement interval
+    int64_t  since  = 0;
+    uint32_t frames = 0;
+    uint64_t bytes  = 0;
+    /// Current quality of the encoder, in the sensor scale
+    int quality = -1;
+};
+using Adapt_t = struct Adapt_s;
+
+static Adapt_t adapt{};
+
+/**
+ * @brief Map sensor JPEG quality (0-63, lower is better) to `frame2jpg` one (1-100)
+ */
+static uint8_t encode_quality_of(const int quality) {
+    return 100 - quality * 90 / 63;
+}
+
+/**
+ * @brief Next frame size by pixel count, the enum isn't ordered by it past UXGA
+ *
+ * @param up Towards more pixels, otherwise fewer
+ *
+ * @return `framesize` if the next one is past `max`, or `min` when stepping down
+ */
+static framesize_t framesize_step(const framesize_t framesize,
+                                  const bool        up,
+                                  const framesize_t min,
+                                  const framesize_t max) {
+    // Only the capture task adapts, it sorts the table on the first call
+    static const std::array<framesize_t, FRAMESIZE_INVALID> by_pixels = [] {
+        std::array<framesize_t, FRAMESIZE_INVALID> sizes{};
+        for (size_t i = 0; i < sizes.size(); i++) sizes[i] = static_cast<framesize_t>(i);
+        std::stable_sort(sizes.begin(), sizes.end(), [](framesize_t a, framesize_t b) {
+            return framesize_pixels(a) < framesize_pixels(b);
+        });
+        return sizes;
+    }();
+
+    const size_t pixels = framesize_pixels(framesize);
+    const size_t limit  = framesize_pixels(up ? max : min);
+    size_t       i = std::find(by_pixels.begin(), by_pixels.end(), framesize) - by_pixels.begin();
+    while (up ? i + 1 < by_pixels.size() : i > 0) {
+        i                 = up ? i + 1 : i - 1;
+        const size_t next = framesize_pixels(by_pixels[i]);
+        // Same pixel count in another aspect ratio, not a step
+        if (next == pixels) continue;
+        if (up ? next > limit : next < limit) break;
+        return by_pixels[i];
+    }
+    return framesize;
+}
+
+/**
+ * @brief Send rate of the slowest active client, 0 if none was measured yet
+ */
+static uint32_t link_throughput() {
+    uint32_t slowest = 0;
+    for (auto &client : clients) {
+        if (!client.active) continue;
+        const uint32_t throughput = client.throughput;
+        if (throughput && (!slowest || throughput < slowest)) slowest = throughput;
+    }
+    return slowest;
+}
+
+/**
+ * @brief Closed-loop JPEG quality control, called for every published frame
+ *
+ * Once per `STREAM_ADAPT_INTERVAL` the average frame size is compared to the
+ * per-frame budget: link throughput over target fps, or the target bitrate
+ * (capped by the link) over the measured fps. Above the budget quality gets
+ * worse and, at `max_quality`, the frame size steps down. Well below it the
+ * frame size is restored first, then quality improves back to `min_quality`
+ *
+ * @note Frame size is only adapted for JPEG sensors, raw frame buffers keep
+ *       the dimensions they were allocated with
+ */
+static void adapt_quality(const size_t frame_len) {
+    const StreamSettings_t &settings = g_settings.stream;
+    if (settings.adapt_mode == STREAM_ADAPT_OFF) return;
+
+    const int64_t now = esp_timer_get_time();
+    if (adapt.since == 0) adapt.since = now;
+    adapt.frames++;
+    adapt.bytes += frame_len;
+
+    const int64_t elapsed = now - adapt.since;
+    if (elapsed < STREAM_ADAPT_INTERVAL * 1000LL) return;
+
+    const uint64_t frame_avg = adapt.bytes / adapt.frames;
+    const uint32_t frames    = adapt.frames;
+    adapt.since              = now;
+    adapt.frames             = 0;
+    adapt.bytes              = 0;
+
+    const uint32_t throughput = link_throughput();
+    if (throughput == 0) return;
+
+    uint64_t budget = 0;
+    if (settings.adapt_mode == STREAM_ADAPT_FPS) {
+        budget = throughput / std::max<uint32_t>(settings.target_fps, 1);
+    } else {
+        const uint64_t rate = std::min<uint64_t>(settings.target_bitrate * 1000ULL / 8, throughput);
+        budget              = rate * elapsed / (frames * 1000000ULL);
+    }
+
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s) return;
+
+    const bool  jpeg          = s->pixformat == PIXFORMAT_JPEG;
+    const auto  max_framesize = g_settings.camera.frame_size;
+    framesize_t framesize     = s->status.framesize;
+    if (adapt.quality < 0) adapt.quality = g_settings.camera.jpeg_quality;
+    int quality = jpeg ? s->status.quality : adapt.quality;
+
+    // Bigger steps when far off
+    const int step = frame_avg > budget * 3 / 2 || frame_avg < budget / 2 ? 4 : 1;
+    if (frame_avg > budget) {
+        if (quality < settings.max_quality) {
+            quality += step;
+        } else if (jpeg && settings.adapt_framesize) {
+            framesize = framesize_step(framesize, false, settings.min_framesize, max_framesize);
+        }
+    } else if (frame_avg < budget * 3 / 4) {
+        const framesize_t larger =
+            jpeg ? framesize_step(framesize, true, settings.min_framesize, max_framesize)
+                 : framesize;
+        if (larger != framesize && frame_avg < budget / 2) {
+            framesize = larger;
+        } else if (quality > settings.min_quality) {
+            quality -= step;
+        }
+    }
+    quality = std::clamp(quality, settings.min_quality, settings.max_quality);
+
+    if (framesize != s->status.framesize) {
+        if (s->set_framesize(s, framesize) != 0) {
+            log_w("Failed to set frame size: %s", framesize_names[framesize]);
+        }
+    }
+    if (jpeg && quality != s->status.quality) {
+        if (s->set_quality(s, quality) != 0) {
+            log_w("Failed to set JPEG quality: %d", quality);
+        }
+    } else if (!jpeg) {
+        adapt.quality  = quality;
+        encode_quality = encode_quality_of(quality);
+    }
+
+    log_i("ADPT: %lluB/frame, budget: %lluB, link: %lukB/s, quality: %d, framesize: %s",
+          frame_avg,
+          budget,
+          throughput / 1000,
+          quality,
+          framesize_names[framesize]);
+}
+
+#pragma endregion
+
+// =============================
+// Snapshots
+// =============================
+
+#pragma region
+
+struct SnapshotSlot_s {
+    stream::Snapshot_t snapshot{};
+    /// Allocated size of `snapshot.buf`, reused by later captures
+    size_t capacity = 0;
+    /// Number of readers, guarded by `snapshot_lock`
+    uint32_t refs = 0;
+};
+using SnapshotSlot_t = struct SnapshotSlot_s;
+
+static constexpr EventBits_t SNAPSHOT_READY = BIT0;
+
+static SnapshotSlot_t     snapshot_slots[STREAM_SNAPSHOT_SLOTS];
+static SnapshotSlot_t    *snapshot_latest  = nullptr;
+static SemaphoreHandle_t  snapshot_lock    = nullptr;
+static EventGroupHandle_t snapshot_events  = nullptr;
+/// Somebody waits for a new frame captured after `snapshot_since`
+static std::atomic<bool> snapshot_pending{false};
+static int64_t           snapshot_since = 0;
+/// Callers waiting for that frame, guarded by `snapshot_lock`
+static uint32_t snapshot_waiters = 0;
+
+/**
+ * @brief Copy the frame into a free cache slot if a snapshot was requested
+ *
+ * @note A frame older than the request is left out, the request waits for the next one
+ */
+static void update_snapshot(const camera_fb_t *fb) {
+    if (!snapshot_pending) return;
+    if (timestamp_us(fb->timestamp) < snapshot_since) return;
+
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    SnapshotSlot_t *slot = nullptr;
+    for (auto &candidate : snapshot_slots) {
+        if (candidate.refs == 0 && &candidate != snapshot_latest) {
+            slot = &candidate;
+            break;
+        }
+    }
+    xSemaphoreGive(snapshot_lock);
+    if (!slot) {
+        log_w("No free snapshot slots");
+        return;
+    }
+
+    if (slot->capacity < fb->len) {
+        heap_caps_free(slot->snapshot.buf);
+        slot->snapshot.buf = static_cast<uint8_t *>(
+            heap_caps_malloc(fb->len, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM));
+        slot->capacity     = slot->snapshot.buf ? fb->len : 0;
+        if (!slot->snapshot.buf) {
+            log_e("Failed to allocate %zuB for the snapshot", fb->len);
+            return;
+        }
+    }
+    memcpy(slot->snapshot.buf, fb->buf, fb->len);
+    slot->snapshot.len       = fb->len;
+    slot->snapshot.width     = fb->width;
+    slot->snapshot.height    = fb->height;
+    slot->snapshot.format    = fb->format;
+    slot->snapshot.timestamp = fb->timestamp;
+
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    snapshot_latest  = slot;
+    snapshot_pending = false;
+    xEventGroupSetBits(snapshot_events, SNAPSHOT_READY);
+    xSemaphoreGive(snapshot_lock);
+}
+
+const stream::Snapshot_t *stream::snapshot(const int64_t max_age_us) {
+    const int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    if (snapshot_latest && now - timestamp_us(snapshot_latest->snapshot.timestamp) <= max_age_us) {
+        snapshot_latest->refs++;
+        xSemaphoreGive(snapshot_lock);
+        return &snapshot_latest->snapshot;
+    }
+    if (!snapshot_pending) {
+        // First one asking, the others wait for the same capture
+        snapshot_since = now;
+        xEventGroupClearBits(snapshot_events, SNAPSHOT_READY);
+        snapshot_pending = true;
+        xTaskNotifyGive(capture_task);
+    }
+    snapshot_waiters++;
+    xSemaphoreGive(snapshot_lock);
+
+    const EventBits_t bits = xEventGroupWaitBits(snapshot_events,
+                                                 SNAPSHOT_READY,
+                                                 pdFALSE,
+                                                 pdTRUE,
+                                                 pdMS_TO_TICKS(STREAM_SNAPSHOT_TIMEOUT));
+
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    snapshot_waiters--;
+    SnapshotSlot_t *slot = nullptr;
+    if (bits & SNAPSHOT_READY) {
+        slot = snapshot_latest;
+        if (slot) slot->refs++;
+    } else if (snapshot_waiters == 0) {
+        // Only the last one giving up cancels the capture, the others still wait for it
+        snapshot_pending = false;
+    }
+    xSemaphoreGive(snapshot_lock);
+
+    if (!(bits & SNAPSHOT_READY)) log_w("Timed out waiting for a snapshot");
+    return slot ? &slot->snapshot : nullptr;
+}
+
+void stream::release(const Snapshot_t *snapshot) {
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    for (auto &slot : snapshot_slots) {
+        if (&slot.snapshot == snapshot) {
+            slot.refs--;
+            break;
+        }
+    }
+    xSemaphoreGive(snapshot_lock);
+}
+
+#pragma endregion
+
+// =============================
+// Capture
+// =============================
+
+#pragma region
+
+/**
+ * @brief Worst-case JPEG size of a frame, used to size the encode buffers
+ *
+ * @param quality Sensor JPEG quality, 0-63 (lower means higher quality)
+ *
+ * @note From 4 bits per pixel at the best quality down to 1 at the worst
+ */
+static size_t jpeg_size_estimate(const framesize_t frame_size, const int quality) {
+    static constexpr size_t JPEG_HEADERS_SIZE = 1024;
+
+    const size_t pixels = resolution[frame_size].width * resolution[frame_size].height;
+    return pixels * (4 * 63 - 3 * quality) / (8 * 63) + JPEG_HEADERS_SIZE;
+}
+
+static bool allocate_encode_pool() {
+    const size_t size =
+        jpeg_size_estimate(g_settings.camera.frame_size, g_settings.camera.jpeg_quality);
+    if (!encode_pool.allocate(size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM)) {
+        log_e("Failed to allocate %zu encode buffers of %zuB", STREAM_ENCODE_POOL_SIZE, size);
+        return false;
+    }
+    log_i("Allocated %zu encode buffers of %zuB", STREAM_ENCODE_POOL_SIZE, size);
+    return true;
+}
+
+struct EncodeOutput_s {
+    uint8_t *buf      = nullptr;
+    size_t   size     = 0;
+    size_t   len      = 0;
+    bool     overflow = false;
+};
+using EncodeOutput_t = struct EncodeOutput_s;
+
+static size_t encode_output(void *arg, size_t index, const void *data, size_t len) {
+    auto *out = static_cast<EncodeOutput_t *>(arg);
+    if (index + len > out->size) {
+        out->overflow = true;
+        return 0;
+    }
+    memcpy(out->buf + index, data, len);
+    out->len = index + len;
+    return len;
+}
+
+/**
+ * @brief Encode non-JPEG frames, pinned to the other core than capture
+ *
+ * @note Encoding frame N overlaps with capturing frame N+1 and with
+ *       the clients sending frame N-1
+ */
+static void encode_task_fn(void *) {
+    camera_fb_t *fb         = nullptr;
+    bool         pool_tried = false;
+
+    while (xQueueReceive(encode_queue, &fb, portMAX_DELAY) == pdTRUE) {
+        // Pixel format may have been switched from JPEG at runtime
+        if (!encode_pool.allocated() && !pool_tried) {
+            pool_tried = true;
+            allocate_encode_pool();
+        }
+        if (!encode_pool.allocated()) {
+            esp_camera_fb_return(fb);
+            encode_pool_exhausted++;
+            publish(nullptr);
+            continue;
+        }
+
+        EncodeOutput_t out{.buf = encode_pool.acquire(), .size = encode_pool.capacity()};
+        if (!out.buf) {
+            esp_camera_fb_return(fb);
+            encode_pool_exhausted++;
+            publish(nullptr);
+            continue;
+        }
+
+        Frame_t *frame = frame_alloc();
+        if (!frame) {
+            log_w("No free frame slots");
+            encode_pool.release(out.buf);
+            esp_camera_fb_return(fb);
+            publish(nullptr);
+            continue;
+        }
+        frame_describe(frame, fb);
+        frame->buf = out.buf;
+
+        const int64_t encode_start = esp_timer_get_time();
+        bool          encoded      = false;
+        {
+            TRACE_SCOPE("frame2jpg");
+            encoded = frame2jpg_cb(fb, encode_quality, encode_output, &out);
+        }
+        stream_stats.encode_time.record(esp_timer_get_time() - encode_start);
+        esp_camera_fb_return(fb);
+        if (!encoded) {
+            if (out.overflow) {
+                log_w("Encoded frame doesn't fit into %zuB", out.size);
+                encode_overflow++;
+            } else {
+                log_e("Failed to encode frame to JPEG");
+                blink_error<ERR_STREAM_SERVER>(ERR_STREAM_ENCODE_JPEG, true);
+            }
+            frame_release(frame);
+            publish(nullptr);
+            continue;
+        }
+        frame->len = out.len;
+
+        publish(frame);
+        adapt_quality(frame->len);
+        frame_release(frame);
+    }
+}
+
+/**
+ * @brief Queue a raw frame for the encode task, replacing a stale one
+ */
+static void encode_frame(camera_fb_t *fb) {
+    if (xQueueSend(encode_queue, &fb, 0) == pdTRUE) return;
+
+    camera_fb_t *stale = nullptr;
+    if (xQueueReceive(encode_queue, &stale, 0) == pdTRUE) {
+        esp_camera_fb_return(stale);
+    }
+    if (xQueueSend(encode_queue, &fb, portMAX_DELAY) != pdTRUE) {
+        esp_camera_fb_return(fb);
+    }
+}
+
+static void capture_task_fn(void *) {
+    int64_t last_frame  = 0;
+    int64_t frame_time  = 0;
+    bool    first_frame = false;
 
     while (true) {
+        if (active_clients == 0 && !snapshot_pending) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        if (held_fbs >= g_settings.camera.fb_count) {
+            // A client still sends from the last frame buffer, the driver has none to fill
+            publish(nullptr);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        if (!snapshot_pending) {
+            const int64_t due = next_capture_due();
+            const int64_t now = esp_timer_get_time();
+            if (due > now) {
+                // Nobody needs a frame yet, sleep until the earliest deadline
+                publish(nullptr);
+                if (due != INT64_MAX) {
+                    esp_timer_stop(pace_timer);
+                    esp_timer_start_once(pace_timer, due - now);
+                }
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue;
+            }
+        }
+
         if constexpr (ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO)
             last_frame = esp_timer_get_time();
 
-        fb = esp_camera_fb_get();
+        camera_fb_t *fb = nullptr;
+        {
+            TRACE_SCOPE("fb_get");
+            fb = esp_camera_fb_get();
+        }
         if (!fb) {
             log_e("Failed to get frame from frambuffer");
             blink_error<ERR_STREAM_SERVER>(ERR_STREAM_GET_FB, true);
-            ret = ESP_FAIL;
+            publish(nullptr);
+            continue;
+        }
+        stream_stats.captured++;
+        if (!first_frame) {
+            first_frame = true;
+            boot::mark("first_frame");
+        }
+
+        // The clients get the frame even if it is too old for the snapshot
+        update_snapshot(fb);
+
+        if (active_clients == 0) {
+            // Captured only for the snapshot
+            esp_camera_fb_return(fb);
+        } else if (fb->format != PIXFORMAT_JPEG) {
+            encode_frame(fb);
         } else {
-            timestamp.tv_sec  = fb->timestamp.tv_sec;
-            timestamp.tv_usec = fb->timestamp.tv_usec;
-            if (fb->format != PIXFORMAT_JPEG) {
-                if (!frame2jpg(fb, FRAME2JPG_QUALITY, &buf, &buf_len)) {
-                    log_e("Failed to encode frame to JPEG");
-                    blink_error<ERR_STREAM_SERVER>(ERR_STREAM_ENCODE_JPEG, true);
-                    ret = ESP_FAIL;
-                }
+            Frame_t *frame = frame_alloc();
+            if (!frame) {
+                log_w("No free frame slots");
                 esp_camera_fb_return(fb);
-                fb = nullptr;
-            } else {
-                buf_len = fb->len;
-                buf     = fb->buf;
+                publish(nullptr);
+                continue;
+            }
+            frame_describe(frame, fb);
+            frame->fb  = fb;
+            frame->buf = fb->buf;
+            frame->len = fb->len;
+            // A single client may hold the last camera frame buffer, the next capture waits
+            // for it. With more, the slowest would hold the others back, so they get a copy
+            if (++held_fbs >= g_settings.camera.fb_count && active_clients > 1 &&
+                !frame_detach(frame)) {
+                log_w("Failed to detach frame from the camera frame buffer");
             }
-        }
 
-        if (ret == ESP_OK) {
-            ret = httpd_resp_send_chunk(req, STREAM_BOUNDARY, sizeof(STREAM_BOUNDARY) - 1);
+            publish(frame);
+            adapt_quality(frame->len);
+            frame_release(frame);
         }
-        if (ret == ESP_OK) {
-            const ssize_t hlen = snprintf(reinterpret_cast<char *>(part_buf),
-                                          STREAM_PART_FULL_LEN,
-                                          STREAM_PART,
-                                          buf_len,
-                                          static_cast<long int>(timestamp.tv_sec),
-                                          static_cast<long int>(timestamp.tv_usec),
-                                          1000.f / frame_time,
-                                          1000.f / avg_frame_time);
-            ret = httpd_resp_send_chunk(req, reinterpret_cast<const char *>(part_buf), hlen);
-        }
-        if (ret == ESP_OK) {
-            ret = httpd_resp_send_chunk(req, reinterpret_cast<const char *>(buf), buf_len);
+
+        if constexpr (ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO) {
+            frame_time = (esp_timer_get_time() - last_frame) / 1000;
+
+            const uint32_t median_frame_time = stream_stats.frame_time.percentile(50) / 1000;
+            log_i("CAPT: %lldms (%.1ffps), P50: %lums (%.1ffps), clients: %zu",
+                  frame_time,
+                  1000.f / frame_time,
+                  median_frame_time,
+                  1000.f / median_frame_time,
+                  active_clients.load());
         }
+    }
+}
 
-        if (fb) {
-            esp_camera_fb_return(fb);
-            fb  = nullptr;
-            buf = nullptr;
-        } else if (buf) {
-            free(buf);
-            buf = nullptr;
+#pragma endregion
+
+// =============================
+// Subscribers
+// =============================
+
+#pragma region
+
+stream::Subscriber_t stream::subscribe(const float fps) {
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    Client_t *client = client_claim();
+    if (!client) {
+        xSemaphoreGive(clients_lock);
+        log_w("Too many stream clients");
+        return -1;
+    }
+    client->kind     = CLIENT_SUBSCRIBER;
+    client->interval = frame_interval(fps);
+    client->next_due = 0;
+    client->holders  = 1;
+    if (!client_start(client, -1)) {
+        client_reset(client);
+        xSemaphoreGive(clients_lock);
+        return -1;
+    }
+    xSemaphoreGive(clients_lock);
+
+    xTaskNotifyGive(capture_task);
+
+    return client - clients;
+}
+
+const stream::FrameInfo_t *stream::next(const Subscriber_t subscriber,
+                                        const TickType_t   timeout) {
+    Frame_t *frame = nullptr;
+    if (xQueueReceive(clients[subscriber].queue, &frame, timeout) != pdTRUE) return nullptr;
+    return frame;
+}
+
+void stream::release(const Subscriber_t subscriber, const FrameInfo_t *frame) {
+    Client_t &client = clients[subscriber];
+    client.sent++;
+    stream_stats.sent++;
+    client.bytes += frame->len;
+    frame_release(const_cast<Frame_t *>(static_cast<const Frame_t *>(frame)));
+    client.busy = false;
+    xTaskNotifyGive(capture_task);
+}
+
+void stream::unsubscribe(const Subscriber_t subscriber) {
+    Client_t &client = clients[subscriber];
+    client.failed    = true;
+    xTaskNotifyGive(capture_task);
+
+    // Wait for the capture task to drop it, like the client tasks do
+    Frame_t *frame = nullptr;
+    while (xQueueReceive(client.queue, &frame, portMAX_DELAY) == pdTRUE && frame) {
+        frame_release(frame);
+    }
+    vQueueDelete(client.queue);
+    client.queue = nullptr;
+    client_put(&client);
+}
+
+#pragma endregion
+
+// =============================
+// Handlers
+// =============================
+
+#pragma region
+
+static esp_err_t stream_handler(httpd_req_t *req) {
+    TRACE_SCOPE("stream_handler");
+    esp_err_t    ret       = ESP_OK;
+    httpd_req_t *async_req = nullptr;
+
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    Client_t *client = client_claim();
+    if (!client) {
+        xSemaphoreGive(clients_lock);
+        log_w("Too many stream clients");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+
+    ret = httpd_req_async_handler_begin(req, &async_req);
+    if (ret != ESP_OK) {
+        xSemaphoreGive(clients_lock);
+        log_e("Failed to start async request, err: %d", ret);
+        blink_error<ERR_STREAM_SERVER>(ERR_STREAM_ASYNC, true);
+        return ret;
+    }
+
+    // Response head is written by the client task together with the first frame
+    client->kind = static_cast<ClientKind_t>(reinterpret_cast<intptr_t>(req->user_ctx));
+    client->req  = async_req;
+    {
+        float fps = 0;
+        char  query[32];
+        char  value[16];
+        if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+            httpd_query_key_value(query, "fps", value, sizeof(value)) == ESP_OK) {
+            fps = strtof(value, nullptr);
         }
+        client->interval = frame_interval(fps);
+        client->next_due = 0;
+    }
+    client->holders = 1;
+    if (!client_start(client, httpd_req_to_sockfd(async_req))) {
+        client->req = nullptr;
+        xSemaphoreGive(clients_lock);
+        httpd_req_async_handler_complete(async_req);
+        return ESP_FAIL;
+    }
+    xSemaphoreGive(clients_lock);
+
+    xTaskNotifyGive(capture_task);
+
+    return ESP_OK;
+}
 
-        if (ret != ESP_OK) {
-            log_w("Failed to send the frame, err: %d", ret);
+/**
+ * @brief Close a socket of the stream server once no client task is writing to it
+ *
+ * @note httpd closes a WebSocket session before calling its `free_ctx`, lwIP
+ *       could hand the number over to a new connection in the meantime
+ */
+static void stream_close(httpd_handle_t, const int fd) {
+    Client_t *client = nullptr;
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    for (auto &slot : clients) {
+        if (slot.in_use && slot.kind == CLIENT_WS && slot.fd == fd) {
+            client = &slot;
             break;
         }
+    }
+    xSemaphoreGive(clients_lock);
 
-        if constexpr (ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO) {
-            frame_time     = (esp_timer_get_time() - last_frame) / 1000;
-            avg_frame_time = ra_filter(static_cast<int32_t>(frame_time));
-            log_i("MJPG: %luB %lldms (%.1ffps), AVG: %lums (%.1ffps)",
-                  buf_len,
-                  frame_time,
-                  1000.f / frame_time,
-                  avg_frame_time,
-                  1000.f / avg_frame_time);
+    // The session still holds the slot, it lets go of it in `free_ctx`
+    if (client) {
+        xSemaphoreTake(client->send_lock, portMAX_DELAY);
+        client->failed = true;
+        xSemaphoreGive(client->send_lock);
+        xTaskNotifyGive(capture_task);
+    }
+    close(fd);
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+/**
+ * @brief Called by the server when a `/ws/stream` session is closed
+ */
+static void ws_session_closed(void *ctx) {
+    auto *client   = static_cast<Client_t *>(ctx);
+    client->failed = true;
+    xTaskNotifyGive(capture_task);
+    client_put(client);
+}
+
+/**
+ * @brief Wake the client task up for a pending PONG or CLOSE, without blocking
+ *
+ * @return `false` if the client task is gone
+ */
+static bool ws_wake(Client_t *client) {
+    Frame_t *wakeup = &ws_wakeup;
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    // Once dropped the task gets nothing after the stop
+    const bool running = client->queue && client->active;
+    // One queued wake-up answers everything pending, more would crowd the frame out
+    if (running && !client->ws_wake_pending.exchange(true) &&
+        xQueueSend(client->queue, &wakeup, 0) != pdTRUE) {
+        client->ws_wake_pending = false;
+    }
+    xSemaphoreGive(clients_lock);
+    return running;
+}
+
+/**
+ * @brief Apply a `{"fps": 2.5, "quality": 12}` control message, both keys optional
+ *
+ * PING and CLOSE are handed to the client task, the only one writing to the socket
+ *
+ * @note Quality is a sensor setting, it applies to every client
+ */
+static esp_err_t ws_control(httpd_req_t *req, Client_t *client) {
+    httpd_ws_frame_t ws_frame{};
+    esp_err_t        ret = httpd_ws_recv_frame(req, &ws_frame, 0);
+    if (ret != ESP_OK) return ret;
+    // httpd only reads a payload whole, one left unread would be taken for the next frame header
+    if (ws_frame.len > STREAM_WS_CONTROL_SIZE) {
+        log_w("WebSocket message too long: %zu, closing", ws_frame.len);
+        return ESP_FAIL;
+    }
+
+    uint8_t buf[STREAM_WS_CONTROL_SIZE];
+    if (ws_frame.len > 0) {
+        ws_frame.payload = buf;
+        ret              = httpd_ws_recv_frame(req, &ws_frame, ws_frame.len);
+        if (ret != ESP_OK) return ret;
+    }
+    switch (ws_frame.type) {
+        case HTTPD_WS_TYPE_TEXT:
+            break;
+        case HTTPD_WS_TYPE_PING:
+            // Still answering the previous one otherwise, which does for this one too
+            if (!client->ws_pong_pending.load(std::memory_order_acquire) &&
+                ws_frame.len <= sizeof(client->ws_ping)) {
+                memcpy(client->ws_ping, buf, ws_frame.len);
+                client->ws_ping_len = ws_frame.len;
+                client->ws_pong_pending.store(true, std::memory_order_release);
+                ws_wake(client);
+            }
+            return ESP_OK;
+        case HTTPD_WS_TYPE_CLOSE:
+            client->ws_close_pending = true;
+            return ws_wake(client) ? ESP_OK : ESP_FAIL;
+        case HTTPD_WS_TYPE_PONG:
+            return ESP_OK;
+        default:
+            log_w("Ignoring WebSocket message, type: %d, length: %zu", ws_frame.type, ws_frame.len);
+            return ESP_OK;
+    }
+
+    JsonDocument         doc;
+    DeserializationError error = deserializeJson(doc, buf, ws_frame.len);
+    if (error) {
+        log_w("deserializeJson() failed: %s", error.c_str());
+        return ESP_OK;
+    }
+
+    if (doc["fps"].template is<float>()) {
+        client->interval = frame_interval(doc["fps"].template as<float>());
+        client->next_due = 0;
+        xTaskNotifyGive(capture_task);
+    }
+    if (doc["quality"].template is<int>()) {
+        // Same range as the `quality` sensor control
+        const int quality = std::clamp(doc["quality"].template as<int>(), 1, 63);
+        sensor_t *s       = esp_camera_sensor_get();
+        if (s && s->pixformat == PIXFORMAT_JPEG) {
+            s->set_quality(s, quality);
+        } else {
+            encode_quality = encode_quality_of(quality);
         }
     }
+    return ESP_OK;
+}
+
+static esp_err_t ws_stream_handler(httpd_req_t *req) {
+    TRACE_SCOPE("ws_stream_handler");
+    if (req->method != HTTP_GET) {
+        auto *client = static_cast<Client_t *>(req->sess_ctx);
+        if (!client) return ESP_FAIL;
+        return ws_control(req, client);
+    }
+
+    // Handshake is done, the session stays open for the frames
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    Client_t *client = client_claim();
+    if (!client) {
+        xSemaphoreGive(clients_lock);
+        log_w("Too many stream clients");
+        return ESP_FAIL;
+    }
+    client->kind     = CLIENT_WS;
+    client->interval = frame_interval(0);
+    client->next_due = 0;
+    // Released by both the client task and the session
+    client->holders = 2;
+    if (!client_start(client, httpd_req_to_sockfd(req))) {
+        client_reset(client);
+        xSemaphoreGive(clients_lock);
+        return ESP_FAIL;
+    }
+    req->sess_ctx = client;
+    req->free_ctx = ws_session_closed;
+    xSemaphoreGive(clients_lock);
+
+    xTaskNotifyGive(capture_task);
+
+    return ESP_OK;
+}
+#endif
+
+const stream::Stats_t &stream::stats() {
+    return stream_stats;
+}
+
+static esp_err_t stats_handler(httpd_req_t *req) {
+    TRACE_SCOPE("stats_handler");
+    static constexpr const char STATS_ENCODE[] =
+        R"({"encode":{"pool_exhausted":%lu,"overflow":%lu},)";
+    static constexpr const char STATS_HISTOGRAM[] =
+        R"("%s":{"count":%lu,"sum":%llu,"min":%lu,"p50":%lu,"p95":%lu,"p99":%lu,"max":%lu},)";
+    static constexpr const char STATS_CLIENT[] =
+        R"({"addr":"%s","sent":%lu,"dropped":%lu,"bytes":%llu})";
+
+    const std::pair<const char *, const stream::StatsHistogram_t *> histograms[] = {
+      {"frame_time", &stream_stats.frame_time},
+      {"frame_size", &stream_stats.frame_size},
+      {"send_time", &stream_stats.send_time},
+      {"latency", &stream_stats.latency},
+    };
 
-    led::enable(false);
+    char buf[std::max(sizeof(STATS_CLIENT) + INET6_ADDRSTRLEN, sizeof(STATS_HISTOGRAM) + 16) +
+             7 * 20];
 
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    const int len = snprintf(buf,
+                             sizeof(buf),
+                             STATS_ENCODE,
+                             static_cast<unsigned long>(encode_pool_exhausted),
+                             static_cast<unsigned long>(encode_overflow));
+
+    esp_err_t ret = httpd_resp_send_chunk(req, buf, len);
+    for (const auto &[name, histogram] : histograms) {
+        if (ret != ESP_OK) break;
+        const int len = snprintf(buf,
+                                 sizeof(buf),
+                                 STATS_HISTOGRAM,
+                                 name,
+                                 static_cast<unsigned long>(histogram->count()),
+                                 static_cast<unsigned long long>(histogram->sum()),
+                                 static_cast<unsigned long>(histogram->min()),
+                                 static_cast<unsigned long>(histogram->percentile(50)),
+                                 static_cast<unsigned long>(histogram->percentile(95)),
+                                 static_cast<unsigned long>(histogram->percentile(99)),
+                                 static_cast<unsigned long>(histogram->max()));
+        ret           = httpd_resp_send_chunk(req, buf, len);
+    }
+    if (ret == ESP_OK) ret = httpd_resp_send_chunk(req, R"("clients":[)", 11);
+    bool first = true;
+    for (const auto &client : clients) {
+        if (ret != ESP_OK) break;
+        if (!client.active) continue;
+        if (!first) ret = httpd_resp_send_chunk(req, ",", 1);
+        first = false;
+        if (ret != ESP_OK) break;
+        const int len = snprintf(buf,
+                                 sizeof(buf),
+                                 STATS_CLIENT,
+                                 client.addr,
+                                 static_cast<unsigned long>(client.sent),
+                                 static_cast<unsigned long>(client.dropped),
+                                 static_cast<unsigned long long>(client.bytes));
+        ret           = httpd_resp_send_chunk(req, buf, len);
+    }
+    if (ret == ESP_OK) ret = httpd_resp_send_chunk(req, "]}", 2);
+    if (ret == ESP_OK) ret = httpd_resp_send_chunk(req, nullptr, 0);
     return ret;
 }
 
+#pragma endregion
+
 httpd_handle_t stream_httpd = nullptr;
 
 void stream::start() {
+    TRACE_SCOPE("stream::start");
     httpd_config_t config   = HTTPD_DEFAULT_CONFIG();
     config.max_uri_handlers = 8;
+    config.max_open_sockets = STREAM_MAX_OPEN_SOCKETS;
+    config.close_fn         = stream_close;
     config.task_priority   += 1;
     config.server_port     += 1;
     config.ctrl_port       += 1;
@@ -147,6 +1597,30 @@ void stream::start() {
       .uri      = "/stream",
       .method   = HTTP_GET,
       .handler  = stream_handler,
+      .user_ctx = reinterpret_cast<void *>(CLIENT_MJPEG),
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+      .is_websocket             = true,
+      .handle_ws_control_frames = false,
+      .supported_subprotocol    = nullptr,
+#endif
+    };
+
+    const httpd_uri_t meta_uri = {
+      .uri      = "/stream/meta",
+      .method   = HTTP_GET,
+      .handler  = stream_handler,
+      .user_ctx = reinterpret_cast<void *>(CLIENT_META),
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+      .is_websocket             = true,
+      .handle_ws_control_frames = false,
+      .supported_subprotocol    = nullptr,
+#endif
+    };
+
+    const httpd_uri_t stats_uri = {
+      .uri      = "/stream/stats",
+      .method   = HTTP_GET,
+      .handler  = stats_handler,
       .user_ctx = nullptr,
 #ifdef CONFIG_HTTPD_WS_SUPPORT
       .is_websocket             = true,
@@ -155,11 +1629,81 @@ void stream::start() {
 #endif
     };
 
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    const httpd_uri_t ws_stream_uri = {
+      .uri                      = "/ws/stream",
+      .method                   = HTTP_GET,
+      .handler                  = ws_stream_handler,
+      .user_ctx                 = nullptr,
+      .is_websocket             = true,
+      // Answered by the client task, httpd writing too could split a frame
+      .handle_ws_control_frames = true,
+      .supported_subprotocol    = nullptr,
+    };
+#endif
+
+    const esp_timer_create_args_t pace_timer_args = {
+      .callback              = pace_timer_cb,
+      .arg                   = nullptr,
+      .dispatch_method       = ESP_TIMER_TASK,
+      .name                  = "stream_pace",
+      .skip_unhandled_events = true,
+    };
+    if (esp_timer_create(&pace_timer_args, &pace_timer) != ESP_OK) {
+        log_e("Failed to create stream pacing timer");
+        blink_error<ERR_STREAM_SERVER>(ERR_STREAM_TASK, true);
+        return;
+    }
+
+    clients_lock    = xSemaphoreCreateMutex();
+    snapshot_lock   = xSemaphoreCreateMutex();
+    snapshot_events = xEventGroupCreate();
+    encode_queue    = xQueueCreate(STREAM_ENCODE_QUEUE_LEN, sizeof(camera_fb_t *));
+    bool send_locks = true;
+    for (auto &client : clients) {
+        client.send_lock = xSemaphoreCreateMutex();
+        send_locks       = send_locks && client.send_lock;
+    }
+    if (!clients_lock || !snapshot_lock || !snapshot_events || !encode_queue || !send_locks ||
+        xTaskCreatePinnedToCore(capture_task_fn,
+                                "stream_capture",
+                                STREAM_TASK_STACK_SIZE,
+                                nullptr,
+                                STREAM_TASK_PRIORITY,
+                                &capture_task,
+                                STREAM_CAPTURE_CORE) != pdPASS ||
+        xTaskCreatePinnedToCore(encode_task_fn,
+                                "stream_encode",
+                                STREAM_ENCODE_STACK_SIZE,
+                                nullptr,
+                                STREAM_TASK_PRIORITY,
+                                &encode_task,
+                                STREAM_ENCODE_CORE) != pdPASS) {
+        log_e("Failed to start stream capture task");
+        blink_error<ERR_STREAM_SERVER>(ERR_STREAM_TASK, true);
+        return;
+    }
+
+    if (g_settings.camera.pixel_format != PIXFORMAT_JPEG) {
+        allocate_encode_pool();
+    }
+
     log_i("Starting Stream Server on port: '%d'", config.server_port);
     esp_err_t res = httpd_start(&stream_httpd, &config);
     if (res == ESP_OK) {
         res = httpd_register_uri_handler(stream_httpd, &stream_uri);
-        if (res != ESP_OK) {
+        if (res != ESP_OK) goto stream_register_uri_handler_failed;
+        res = httpd_register_uri_handler(stream_httpd, &meta_uri);
+        if (res != ESP_OK) goto stream_register_uri_handler_failed;
+        res = httpd_register_uri_handler(stream_httpd, &stats_uri);
+        if (res != ESP_OK) goto stream_register_uri_handler_failed;
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+        res = httpd_register_uri_handler(stream_httpd, &ws_stream_uri);
+        if (res != ESP_OK) goto stream_register_uri_handler_failed;
+#endif
+
+        if (false) {
+        stream_register_uri_handler_failed:
             log_e("Failed to register URI handler, err: %d", res);
             blink_error<ERR_STREAM_SERVER>(ERR_STREAM_REG_URI, true);
         }
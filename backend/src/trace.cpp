@@ -0,0 +1,110 @@
+#include "trace.hpp"
+
+#if TRACE_ENABLED
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+
+#include "tools/trace_ring.hpp"
+#include "config.hpp"
+
+static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0,
+              "TRACE_BUFFER_EVENTS must be a power of two");
+
+static constexpr const char TRACE_HEADER[] =
+    R"({"displayTimeUnit":"ms","otherData":{"recorded":%lu,"capacity":%zu},"traceEvents":[)"
+    R"({"name":"process_name","ph":"M","pid":1,"tid":0,"args":{"name":"ESP32-CAM"}})";
+static constexpr const char TRACE_THREAD[] =
+    R"(,{"name":"thread_name","ph":"M","pid":1,"tid":%d,"args":{"name":"Core %d"}})";
+static constexpr const char TRACE_EVENT[] =
+    R"(,{"name":"%s","cat":"esp32cam","ph":"X","ts":%lld,"dur":%lu,"pid":1,"tid":%u})";
+static constexpr const char TRACE_FOOTER[] = "]}";
+
+static TraceRing trace_ring;
+
+/// Reused by every dump, the app server handles one request at a time
+static char trace_buf[TRACE_CHUNK_SIZE];
+
+struct TraceWriter_s {
+    httpd_req_t *req = nullptr;
+    size_t       len = 0;
+    esp_err_t    err = ESP_OK;
+};
+using TraceWriter_t = struct TraceWriter_s;
+
+static void trace_flush(TraceWriter_t &out) {
+    if (out.err == ESP_OK && out.len > 0) {
+        out.err = httpd_resp_send_chunk(out.req, trace_buf, out.len);
+    }
+    out.len = 0;
+}
+
+/**
+ * @brief Append to `trace_buf`, sending the buffer first if it doesn't fit
+ */
+__attribute__((format(printf, 2, 3))) static void trace_printf(TraceWriter_t &out,
+                                                               const char    *format,
+                                                               ...) {
+    for (int attempt = 0; attempt < 2 && out.err == ESP_OK; attempt++) {
+        va_list args;
+        va_start(args, format);
+        const int len = vsnprintf(trace_buf + out.len, sizeof(trace_buf) - out.len, format, args);
+        va_end(args);
+        if (len < 0) break;
+        if (out.len + len < sizeof(trace_buf)) {
+            out.len += len;
+            return;
+        }
+        trace_flush(out);
+    }
+}
+
+void trace::record(const char *name, const int64_t start, const int64_t end) {
+    trace_ring.record({
+      .name     = name,
+      .start    = start,
+      .duration = static_cast<uint32_t>(end - start),
+      .core     = static_cast<uint8_t>(xPortGetCoreID()),
+    });
+}
+
+esp_err_t trace::send_json(httpd_req_t *req) {
+    TraceWriter_t out{.req = req};
+
+    trace_printf(out, TRACE_HEADER, trace_ring.recorded(), trace_ring.capacity());
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        trace_printf(out, TRACE_THREAD, core, core);
+    }
+    trace_ring.for_each([&out](const TraceEvent_t &event) {
+        trace_printf(out,
+                     TRACE_EVENT,
+                     event.name,
+                     static_cast<long long>(event.start),
+                     static_cast<unsigned long>(event.duration),
+                     event.core);
+    });
+    trace_printf(out, "%s", TRACE_FOOTER);
+
+    trace_flush(out);
+    if (out.err != ESP_OK) return out.err;
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+void trace::start() {
+    void *slots = heap_caps_malloc(TRACE_BUFFER_EVENTS * sizeof(TraceSlot_t),
+                                   MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+    if (!slots) {
+        // Tracing is a debugging aid, run without it
+        log_w("Failed to allocate %zu trace events", TRACE_BUFFER_EVENTS);
+        return;
+    }
+    trace_ring.attach(slots, TRACE_BUFFER_EVENTS);
+    log_i("Tracing %zu events", TRACE_BUFFER_EVENTS);
+}
+
+#endif
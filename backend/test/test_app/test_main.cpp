@@ -4,6 +4,7 @@
 #include "hw/camera.hpp"
 
 #include "json.hpp"
+#include "tools/gzip.hpp"
 
 #include "tests/main.hpp"
 #include "tests/app.hpp"
@@ -63,6 +64,26 @@ void test_generate_openapi_json(void) {
     }
 }
 
+void test_gzip_compress(void) {
+    const String json = app::test::generate_openapi_json(sensor);
+    size_t       len  = 0;
+    uint8_t     *gzip = gzip_compress(json.c_str(), json.length(), &len, MALLOC_CAP_8BIT);
+    TEST_ASSERT_NOT_NULL(gzip);
+    TEST_ASSERT_LESS_THAN(json.length(), len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(GZIP_HEADER, gzip, sizeof(GZIP_HEADER));
+
+    auto          *inflated     = static_cast<char *>(malloc(json.length()));
+    const uint8_t *deflated     = gzip + sizeof(GZIP_HEADER);
+    const size_t   deflated_len = len - sizeof(GZIP_HEADER) - GZIP_TRAILER_SIZE;
+    const size_t   inflated_len =
+        tinfl_decompress_mem_to_mem(inflated, json.length(), deflated, deflated_len, 0);
+    TEST_ASSERT_EQUAL(json.length(), inflated_len);
+    TEST_ASSERT_EQUAL_MEMORY(json.c_str(), inflated, json.length());
+
+    free(inflated);
+    heap_caps_free(gzip);
+}
+
 void test_generate_settings_json(void) {
     String settings_json = app::test::generate_settings_json(sensor, false);
     TEST_ASSERT_TRUE(settings_json);
@@ -139,6 +160,7 @@ void setup() {
     RUN_TEST(test_sensor_schema);
 
     RUN_TEST(test_generate_openapi_json);
+    RUN_TEST(test_gzip_compress);
 
     RUN_TEST(test_generate_settings_json);
     RUN_TEST(test_generate_settings_json_with_types);
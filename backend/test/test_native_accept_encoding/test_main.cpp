@@ -0,0 +1,55 @@
+#include <unity.h>
+
+#include "tools/accept_encoding.hpp"
+
+// Everything below is checked by the compiler already
+static_assert(accepts_encoding("gzip, deflate, br, zstd", "br"));
+static_assert(!accepts_encoding("gzip, deflate", "br"));
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_browsers(void) {
+    // Chrome and Firefox, over HTTPS and over HTTP
+    TEST_ASSERT_TRUE(accepts_encoding("gzip, deflate, br, zstd", "br"));
+    TEST_ASSERT_TRUE(accepts_encoding("gzip, deflate, br, zstd", "gzip"));
+    TEST_ASSERT_FALSE(accepts_encoding("gzip, deflate", "br"));
+    TEST_ASSERT_FALSE(accepts_encoding("", "gzip"));
+}
+
+void test_weights(void) {
+    TEST_ASSERT_TRUE(accepts_encoding("br;q=1.0, gzip;q=0.8", "br"));
+    TEST_ASSERT_TRUE(accepts_encoding("br;q=0.001", "br"));
+    TEST_ASSERT_TRUE(accepts_encoding("br ; q=0.5", "br"));
+    TEST_ASSERT_FALSE(accepts_encoding("br;q=0", "br"));
+    TEST_ASSERT_FALSE(accepts_encoding("gzip, br;q=0.000", "br"));
+    TEST_ASSERT_FALSE(accepts_encoding("br;Q=0.", "br"));
+}
+
+void test_wildcard(void) {
+    TEST_ASSERT_TRUE(accepts_encoding("*", "br"));
+    TEST_ASSERT_TRUE(accepts_encoding("gzip;q=1, *;q=0.1", "br"));
+    TEST_ASSERT_FALSE(accepts_encoding("*;q=0", "br"));
+    // The coding listed by name wins over `*`
+    TEST_ASSERT_FALSE(accepts_encoding("*, br;q=0", "br"));
+    TEST_ASSERT_TRUE(accepts_encoding("br, *;q=0", "br"));
+}
+
+void test_tokens(void) {
+    TEST_ASSERT_TRUE(accepts_encoding("GZIP", "gzip"));
+    TEST_ASSERT_TRUE(accepts_encoding("  br  ,gzip", "br"));
+    TEST_ASSERT_FALSE(accepts_encoding("brotli, xbr", "br"));
+    TEST_ASSERT_FALSE(accepts_encoding("gzip,,", "br"));
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_browsers);
+    RUN_TEST(test_weights);
+    RUN_TEST(test_wildcard);
+    RUN_TEST(test_tokens);
+
+    return UNITY_END();
+}
@@ -0,0 +1,94 @@
+#include <unity.h>
+
+#include <cstring>
+
+#include "tools/bundle_image.hpp"
+
+static constexpr size_t PARTITION_SIZE = 0x80000;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/**
+ * @brief Header of `index.html.gz` and `api.html.gz`, as `make_bundle -p` packs them
+ */
+static BundleHeader_t make_header() {
+    BundleHeader_t header{};
+    header.magic   = BUNDLE_MAGIC;
+    header.version = BUNDLE_VERSION;
+    header.count   = 2;
+
+    strcpy(header.entries[0].name, "index.html.gz");
+    header.entries[0].offset = sizeof(BundleHeader_t);
+    header.entries[0].size   = 1000;
+    strcpy(header.entries[1].name, "api.html.gz");
+    header.entries[1].offset = sizeof(BundleHeader_t) + 1008;
+    header.entries[1].size   = 333;
+
+    header.size = header.entries[1].offset + 336;
+    return header;
+}
+
+void test_valid(void) {
+    const BundleHeader_t header = make_header();
+    TEST_ASSERT_NULL(bundle_header_check(header, PARTITION_SIZE));
+    TEST_ASSERT_EQUAL_PTR(&header.entries[0], bundle_find(header, "index.html.gz"));
+    TEST_ASSERT_EQUAL_PTR(&header.entries[1], bundle_find(header, "api.html.gz"));
+    TEST_ASSERT_NULL(bundle_find(header, "index.html"));
+    TEST_ASSERT_NULL(bundle_find(header, ""));
+}
+
+void test_erased(void) {
+    BundleHeader_t header;
+    memset(&header, 0xFF, sizeof(header));
+    TEST_ASSERT_NOT_NULL(bundle_header_check(header, PARTITION_SIZE));
+}
+
+void test_version(void) {
+    BundleHeader_t header = make_header();
+    header.version++;
+    TEST_ASSERT_NOT_NULL(bundle_header_check(header, PARTITION_SIZE));
+}
+
+void test_bounds(void) {
+    BundleHeader_t header = make_header();
+    TEST_ASSERT_NOT_NULL(bundle_header_check(header, header.size - 1));
+
+    header       = make_header();
+    header.count = BUNDLE_MAX_ENTRIES + 1;
+    TEST_ASSERT_NOT_NULL(bundle_header_check(header, PARTITION_SIZE));
+
+    // Entry over the header
+    header                   = make_header();
+    header.entries[0].offset = 0;
+    TEST_ASSERT_NOT_NULL(bundle_header_check(header, PARTITION_SIZE));
+
+    // Entry past the end, without overflowing `offset + size`
+    header                 = make_header();
+    header.entries[1].size = UINT32_MAX;
+    TEST_ASSERT_NOT_NULL(bundle_header_check(header, PARTITION_SIZE));
+
+    // Entries past `count` are not checked
+    header                   = make_header();
+    header.entries[2].offset = UINT32_MAX;
+    TEST_ASSERT_NULL(bundle_header_check(header, PARTITION_SIZE));
+}
+
+void test_name(void) {
+    BundleHeader_t header = make_header();
+    memset(header.entries[1].name, 'a', BUNDLE_NAME_SIZE);
+    TEST_ASSERT_NOT_NULL(bundle_header_check(header, PARTITION_SIZE));
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_valid);
+    RUN_TEST(test_erased);
+    RUN_TEST(test_version);
+    RUN_TEST(test_bounds);
+    RUN_TEST(test_name);
+
+    return UNITY_END();
+}
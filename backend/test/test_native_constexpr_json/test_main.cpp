@@ -0,0 +1,109 @@
+#include <unity.h>
+
+#include <cstring>
+
+#include <string_view>
+
+#include "tools/constexpr_json.hpp"
+
+static constexpr std::string_view SCHEMA = R"json(
+{
+    "type": "object",
+    "properties": {
+        "framesize": { "type": "integer", "minimum": 0, "maximum": 21 },
+        "label": { "type": "string", "default": "a \"quoted\" \\ value" },
+        "steps": [1, 2.5, -3e+2]
+    }
+}
+)json";
+
+static constexpr auto SCHEMA_MINIFIED = json_minify<json_minified_size(SCHEMA)>(SCHEMA);
+
+// Everything below is checked by the compiler already
+static_assert(json_valid(SCHEMA));
+static_assert(json_valid(SCHEMA_MINIFIED.data()));
+static_assert(json_pointer(SCHEMA, "/properties/framesize/maximum") == "21");
+static_assert(json_pointer(SCHEMA, "/properties/steps/1") == "2.5");
+static_assert(json_pointer(SCHEMA, "/missing").empty());
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_valid(void) {
+    const std::string_view valid[] = {
+      "{}",
+      " [ ] ",
+      "0",
+      "-0.5e-10",
+      "\"\\u00e9\\n\"",
+      "true",
+      "null",
+      R"({"a":[{"b":false},null,"c"]})",
+    };
+    for (const auto json : valid) TEST_ASSERT_TRUE_MESSAGE(json_valid(json), json.data());
+}
+
+void test_invalid(void) {
+    const std::string_view invalid[] = {
+      "",
+      "{",
+      "{}}",
+      "[1,]",
+      R"({"a":1,})",
+      R"({"a" 1})",
+      R"({a:1})",
+      "01",
+      "1.",
+      "-",
+      "1e",
+      "tru",
+      "\"\\x\"",
+      "\"\\u12\"",
+      "\"unterminated",
+      "[1] [2]",
+    };
+    for (const auto json : invalid) TEST_ASSERT_FALSE_MESSAGE(json_valid(json), json.data());
+
+    // Too deep
+    char deep[2 * (JSON_MAX_DEPTH + 1) + 1]{};
+    for (size_t i = 0; i <= JSON_MAX_DEPTH; i++) {
+        deep[i]                          = '[';
+        deep[2 * JSON_MAX_DEPTH + 1 - i] = ']';
+    }
+    TEST_ASSERT_FALSE(json_valid(deep));
+}
+
+void test_minify(void) {
+    TEST_ASSERT_EQUAL_STRING(R"({"type":"object","properties":{"framesize":{"type":"integer",)"
+                             R"("minimum":0,"maximum":21},"label":{"type":"string",)"
+                             R"("default":"a \"quoted\" \\ value"},"steps":[1,2.5,-3e+2]}})",
+                             SCHEMA_MINIFIED.data());
+    TEST_ASSERT_EQUAL(json_minified_size(SCHEMA), strlen(SCHEMA_MINIFIED.data()));
+}
+
+void test_pointer(void) {
+    const std::string_view minified = SCHEMA_MINIFIED.data();
+
+    TEST_ASSERT_TRUE(json_pointer(minified, "") == minified);
+    TEST_ASSERT_TRUE(json_pointer(minified, "/type") == "\"object\"");
+    TEST_ASSERT_TRUE(json_pointer(minified, "/properties/framesize") ==
+                     R"({"type":"integer","minimum":0,"maximum":21})");
+    TEST_ASSERT_TRUE(json_pointer(minified, "/properties/steps/2") == "-3e+2");
+    TEST_ASSERT_TRUE(json_pointer(minified, "/properties/steps/3").empty());
+    TEST_ASSERT_TRUE(json_pointer(minified, "/properties/steps/x").empty());
+    TEST_ASSERT_TRUE(json_pointer(minified, "/type/x").empty());
+    // Keys are whole tokens, not prefixes
+    TEST_ASSERT_TRUE(json_pointer(minified, "/prop").empty());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_valid);
+    RUN_TEST(test_invalid);
+    RUN_TEST(test_minify);
+    RUN_TEST(test_pointer);
+
+    return UNITY_END();
+}
@@ -0,0 +1,150 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "tools/histogram.hpp"
+
+static constexpr int BENCHMARK_ITERATIONS = 1000000;
+static constexpr int THREADS              = 4;
+static constexpr int THREAD_SAMPLES       = 100000;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_buckets(void) {
+    using H = Histogram<3, 32>;
+
+    TEST_ASSERT_EQUAL(240, H::BUCKETS);
+    for (uint32_t value = 0; value < 8; value++) TEST_ASSERT_EQUAL(value, H::bucket_of(value));
+    TEST_ASSERT_EQUAL(8, H::bucket_of(8));
+    TEST_ASSERT_EQUAL(15, H::bucket_of(15));
+    TEST_ASSERT_EQUAL(16, H::bucket_of(16));
+    TEST_ASSERT_EQUAL(16, H::bucket_of(17));
+    TEST_ASSERT_EQUAL(H::BUCKETS - 1, H::bucket_of(UINT32_MAX));
+
+    // Buckets are contiguous and every value lands in its own
+    for (size_t bucket = 0; bucket + 1 < H::BUCKETS; bucket++) {
+        TEST_ASSERT_EQUAL(H::bucket_upper(bucket) + 1, H::bucket_lower(bucket + 1));
+        TEST_ASSERT_EQUAL(bucket, H::bucket_of(H::bucket_lower(bucket)));
+        TEST_ASSERT_EQUAL(bucket, H::bucket_of(H::bucket_upper(bucket)));
+    }
+}
+
+void test_clamp(void) {
+    using H = Histogram<3, 16>;
+
+    TEST_ASSERT_EQUAL(H::BUCKETS - 1, H::bucket_of(1 << 16));
+    TEST_ASSERT_EQUAL(H::BUCKETS - 1, H::bucket_of(UINT32_MAX));
+    TEST_ASSERT_EQUAL(UINT32_MAX, H::bucket_upper(H::BUCKETS - 1));
+}
+
+void test_empty(void) {
+    Histogram<> histogram{};
+    TEST_ASSERT_EQUAL(0, histogram.count());
+    TEST_ASSERT_EQUAL(0, histogram.min());
+    TEST_ASSERT_EQUAL(0, histogram.max());
+    TEST_ASSERT_EQUAL(0, histogram.percentile(50));
+}
+
+void test_percentiles(void) {
+    Histogram<> histogram{};
+    for (uint32_t value = 1; value <= 1000; value++) histogram.record(value);
+
+    TEST_ASSERT_EQUAL(1000, histogram.count());
+    TEST_ASSERT_EQUAL(500500, histogram.sum());
+    TEST_ASSERT_EQUAL(1, histogram.min());
+    TEST_ASSERT_EQUAL(1000, histogram.max());
+    // Within a bucket of the exact value
+    TEST_ASSERT_UINT32_WITHIN(500 / 8, 500, histogram.percentile(50));
+    TEST_ASSERT_UINT32_WITHIN(950 / 8, 950, histogram.percentile(95));
+    TEST_ASSERT_UINT32_WITHIN(990 / 8, 990, histogram.percentile(99));
+    TEST_ASSERT_EQUAL(1, histogram.percentile(0));
+    TEST_ASSERT_EQUAL(1000, histogram.percentile(100));
+
+    histogram.clear();
+    TEST_ASSERT_EQUAL(0, histogram.count());
+    TEST_ASSERT_EQUAL(0, histogram.percentile(50));
+}
+
+void test_single_value(void) {
+    Histogram<> histogram{};
+    for (int i = 0; i < 10; i++) histogram.record(33333);
+    TEST_ASSERT_EQUAL(33333, histogram.percentile(50));
+    TEST_ASSERT_EQUAL(33333, histogram.percentile(99));
+}
+
+void test_concurrent(void) {
+    Histogram<> histogram{};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&histogram, t] {
+            for (int i = 0; i < THREAD_SAMPLES; i++) histogram.record(t * 1000 + i % 1000);
+        });
+    }
+    // Read while the writers are busy
+    while (histogram.count() < THREADS * THREAD_SAMPLES / 2) histogram.percentile(99);
+    for (auto &thread : threads) thread.join();
+
+    uint64_t buckets = 0;
+    for (size_t i = 0; i < histogram.BUCKETS; i++) buckets += histogram.bucket(i);
+    TEST_ASSERT_EQUAL(THREADS * THREAD_SAMPLES, histogram.count());
+    TEST_ASSERT_EQUAL(THREADS * THREAD_SAMPLES, buckets);
+    TEST_ASSERT_EQUAL(0, histogram.min());
+    TEST_ASSERT_EQUAL((THREADS - 1) * 1000 + 999, histogram.max());
+}
+
+/**
+ * @brief Per-sample cost of `record`, on the host
+ */
+void test_benchmark(void) {
+    Histogram<> histogram{};
+    uint32_t    value = 12345;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        // xorshift, so the samples spread over the buckets
+        value ^= value << 13;
+        value ^= value >> 17;
+        value ^= value << 5;
+        histogram.record(value >> (value & 0xF));
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    const double record_ns =
+        std::chrono::duration<double, std::nano>(end - start).count() / BENCHMARK_ITERATIONS;
+    const auto percentile_start = std::chrono::steady_clock::now();
+    const auto p99              = histogram.percentile(99);
+    const auto percentile_end   = std::chrono::steady_clock::now();
+    const double percentile_ns =
+        std::chrono::duration<double, std::nano>(percentile_end - percentile_start).count();
+
+    char message[128];
+    snprintf(message,
+             sizeof(message),
+             "record: %.1fns, percentile: %.0fns, p99: %lu",
+             record_ns,
+             percentile_ns,
+             static_cast<unsigned long>(p99));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(BENCHMARK_ITERATIONS, histogram.count());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_buckets);
+    RUN_TEST(test_clamp);
+    RUN_TEST(test_empty);
+    RUN_TEST(test_percentiles);
+    RUN_TEST(test_single_value);
+    RUN_TEST(test_concurrent);
+
+    RUN_TEST(test_benchmark);
+
+    return UNITY_END();
+}
@@ -0,0 +1,192 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "tools/part_header.hpp"
+
+/// The part header `stream.cpp` formatted with `snprintf` before
+static constexpr const char SNPRINTF_PART[]      = "Content-Type: image/jpeg\r\n"
+                                                   "Content-Length: %zu\r\n"
+                                                   "X-Timestamp: %ld.%06ld\r\n"
+                                                   "X-Framerate: %.1f\r\n"
+                                                   "X-Average-Framerate: %.1f\r\n\r\n";
+static constexpr size_t     SNPRINTF_PART_LEN    = sizeof(SNPRINTF_PART) * 1.5f;
+static constexpr int        BENCHMARK_ITERATIONS = 200000;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/**
+ * @brief Read a header value back, ignoring the padding
+ */
+static double header_value(const char *header, const char *name) {
+    const char *line = strstr(header, name);
+    TEST_ASSERT_NOT_NULL(line);
+    return strtod(line + strlen(name), nullptr);
+}
+
+void test_template_layout(void) {
+    TEST_ASSERT_EQUAL(10, part_header_span(PART_CONTENT_LENGTH).width);
+    TEST_ASSERT_EQUAL(10, part_header_span(PART_TIMESTAMP_SEC).width);
+    TEST_ASSERT_EQUAL(6, part_header_span(PART_TIMESTAMP_USEC).width);
+    TEST_ASSERT_EQUAL(1, part_header_span(PART_FRAMERATE_TENTHS).width);
+    TEST_ASSERT_EQUAL(0, part_header_span(PART_FIELD_COUNT).width);
+}
+
+void test_build(void) {
+    char header[PART_HEADER_SIZE + 1]{};
+    const PartHeader_t fields = {
+      .content_length    = 12345,
+      .timestamp_sec     = 1700000000,
+      .timestamp_usec    = 42,
+      .frame_time_ms     = 40,
+      .avg_frame_time_ms = 33,
+      .seq               = 7,
+      .latency_us        = 15250,
+      .exposure          = 1200,
+      .gain              = 30,
+    };
+    TEST_ASSERT_EQUAL(PART_HEADER_SIZE, part_header_build(header, fields));
+
+    TEST_ASSERT_NULL(strchr(header, '#'));
+    TEST_ASSERT_NOT_NULL(strstr(header, "Content-Length:      12345\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Timestamp: 1700000000.000042\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Framerate:    25.0\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Average-Framerate:    30.3\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Sequence:          7\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Latency:      15250\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Exposure:  1200\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Gain:  30\r\n"));
+    TEST_ASSERT_EQUAL_STRING("\r\n\r\n", header + PART_HEADER_SIZE - 4);
+}
+
+void test_build_matches_snprintf(void) {
+    const int64_t frame_times[] = {1, 7, 33, 40, 66, 100, 999, 1000, 12345};
+
+    for (const int64_t frame_time : frame_times) {
+        char header[PART_HEADER_SIZE + 1]{};
+        char expected[SNPRINTF_PART_LEN];
+        part_header_build(header,
+                          {
+                            .content_length    = 98765,
+                            .timestamp_sec     = 12,
+                            .timestamp_usec    = 999999,
+                            .frame_time_ms     = frame_time,
+                            .avg_frame_time_ms = frame_time,
+                          });
+        snprintf(expected,
+                 sizeof(expected),
+                 SNPRINTF_PART,
+                 static_cast<size_t>(98765),
+                 12L,
+                 999999L,
+                 1000.f / frame_time,
+                 1000.f / frame_time);
+
+        TEST_ASSERT_EQUAL_DOUBLE(header_value(expected, "Content-Length:"),
+                                 header_value(header, "Content-Length:"));
+        TEST_ASSERT_EQUAL_DOUBLE(header_value(expected, "X-Timestamp:"),
+                                 header_value(header, "X-Timestamp:"));
+        TEST_ASSERT_DOUBLE_WITHIN(0.05,
+                                  header_value(expected, "X-Framerate:"),
+                                  header_value(header, "X-Framerate:"));
+    }
+}
+
+void test_zero_and_overflow(void) {
+    char header[PART_HEADER_SIZE + 1]{};
+    part_header_build(header, {.timestamp_sec = -1, .latency_us = -1});
+    TEST_ASSERT_NOT_NULL(strstr(header, "Content-Length:          0\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Timestamp:          0.000000\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Framerate:     0.0\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(header, "X-Latency:          0\r\n"));
+
+    part_header_build(header, {.content_length = static_cast<size_t>(99999999999ULL)});
+    TEST_ASSERT_NOT_NULL(strstr(header, "Content-Length: 9999999999\r\n"));
+    TEST_ASSERT_EQUAL(PART_HEADER_SIZE, strlen(header));
+}
+
+void test_put_hex(void) {
+    char   buf[2 * sizeof(size_t) + 1]{};
+    size_t len = part_header_put_hex(buf, 0);
+    TEST_ASSERT_EQUAL(1, len);
+    TEST_ASSERT_EQUAL_STRING_LEN("0", buf, len);
+
+    len = part_header_put_hex(buf, 0x1a2b3c);
+    TEST_ASSERT_EQUAL(6, len);
+    TEST_ASSERT_EQUAL_STRING_LEN("1a2b3c", buf, len);
+}
+
+/**
+ * @brief Compare with the `snprintf` path, on the host
+ *
+ * @note Only the ratio means something, the Xtensa core has no double-precision
+ *       FPU so `%.1f` costs much more there
+ */
+void test_benchmark(void) {
+    char     header[PART_HEADER_SIZE];
+    char     expected[SNPRINTF_PART_LEN];
+    uint32_t sink = 0;
+
+    const auto build_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        sink += part_header_build(header,
+                                  {
+                                    .content_length    = static_cast<size_t>(20000 + i),
+                                    .timestamp_sec     = 1700000000 + i,
+                                    .timestamp_usec    = static_cast<uint32_t>(i % 1000000),
+                                    .frame_time_ms     = 33 + i % 8,
+                                    .avg_frame_time_ms = 35,
+                                  });
+        sink += header[40];
+    }
+    const auto build_end = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        sink += snprintf(expected,
+                         sizeof(expected),
+                         SNPRINTF_PART,
+                         static_cast<size_t>(20000 + i),
+                         1700000000L + i,
+                         static_cast<long>(i % 1000000),
+                         1000.f / (33 + i % 8),
+                         1000.f / 35);
+        sink += expected[40];
+    }
+    const auto snprintf_end = std::chrono::steady_clock::now();
+
+    const double build_ns =
+        std::chrono::duration<double, std::nano>(build_end - build_start).count() /
+        BENCHMARK_ITERATIONS;
+    const double snprintf_ns =
+        std::chrono::duration<double, std::nano>(snprintf_end - build_end).count() /
+        BENCHMARK_ITERATIONS;
+
+    char message[128];
+    snprintf(message,
+             sizeof(message),
+             "part_header_build: %.1fns, snprintf: %.1fns (%.1fx), %lu",
+             build_ns,
+             snprintf_ns,
+             snprintf_ns / build_ns,
+             static_cast<unsigned long>(sink));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN_DOUBLE(snprintf_ns, build_ns);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_template_layout);
+    RUN_TEST(test_build);
+    RUN_TEST(test_build_matches_snprintf);
+    RUN_TEST(test_zero_and_overflow);
+    RUN_TEST(test_put_hex);
+
+    RUN_TEST(test_benchmark);
+
+    return UNITY_END();
+}
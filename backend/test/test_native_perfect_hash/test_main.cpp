@@ -0,0 +1,107 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "tools/perfect_hash.hpp"
+#include "types/sensor.hpp"
+
+static constexpr int BENCHMARK_ITERATIONS = 100000;
+
+static constexpr PerfectHash<SENSOR_CONTROL_COUNT> sensor_control_hash(sensor_control_keys());
+static_assert(sensor_control_hash.valid());
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/**
+ * @brief The `strcmp` chain `process_sensor_json` walked before
+ */
+static int find_chain(const char *key) {
+#define X(key_name, value, minimum, maximum, format) \
+    if (strcmp(key, #key_name) == 0) return SENSOR_CONTROL_##key_name;
+    SENSOR_CONTROLS
+#undef X
+    return -1;
+}
+
+void test_every_key(void) {
+    for (size_t i = 0; i < SENSOR_CONTROL_COUNT; i++) {
+        TEST_ASSERT_EQUAL(i, sensor_control_hash.find(sensor_controls[i].key));
+        TEST_ASSERT_EQUAL(i, find_chain(sensor_controls[i].key.data()));
+    }
+}
+
+void test_unknown_keys(void) {
+    const char *unknown[] = {"", "frame", "framesize_", "Framesize", "lenc ", "set_lenc", "awb"};
+    for (const char *key : unknown) {
+        TEST_ASSERT_EQUAL(-1, sensor_control_hash.find(key));
+        TEST_ASSERT_EQUAL(-1, find_chain(key));
+    }
+}
+
+void test_duplicate_keys(void) {
+    constexpr PerfectHash<3> hash({"a", "b", "a"});
+    TEST_ASSERT_FALSE(hash.valid());
+}
+
+void test_ranges(void) {
+    TEST_ASSERT_EQUAL(-2, sensor_controls[SENSOR_CONTROL_brightness].minimum);
+    TEST_ASSERT_EQUAL(2, sensor_controls[SENSOR_CONTROL_brightness].maximum);
+    TEST_ASSERT_EQUAL(65535, sensor_controls[SENSOR_CONTROL_aec_value].maximum);
+    for (const auto &control : sensor_controls) {
+        TEST_ASSERT_LESS_THAN(control.maximum, control.minimum);
+    }
+}
+
+/**
+ * @brief Look up every control once, as a full `/sensor` update does, on the host
+ */
+void test_benchmark(void) {
+    const char *keys[SENSOR_CONTROL_COUNT];
+    for (size_t i = 0; i < SENSOR_CONTROL_COUNT; i++) keys[i] = sensor_controls[i].key.data();
+    volatile int sink = 0;
+
+    const auto hash_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        for (const char *key : keys) sink = sink + sensor_control_hash.find(key);
+    }
+    const auto chain_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        for (const char *key : keys) sink = sink + find_chain(key);
+    }
+    const auto chain_end = std::chrono::steady_clock::now();
+
+    const double hash_ns =
+        std::chrono::duration<double, std::nano>(chain_start - hash_start).count() /
+        BENCHMARK_ITERATIONS;
+    const double chain_ns =
+        std::chrono::duration<double, std::nano>(chain_end - chain_start).count() /
+        BENCHMARK_ITERATIONS;
+
+    char message[128];
+    snprintf(message,
+             sizeof(message),
+             "%d keys, perfect hash: %.0fns, strcmp chain: %.0fns (%.1fx)",
+             SENSOR_CONTROL_COUNT,
+             hash_ns,
+             chain_ns,
+             chain_ns / hash_ns);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN_DOUBLE(chain_ns, hash_ns);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_every_key);
+    RUN_TEST(test_unknown_keys);
+    RUN_TEST(test_duplicate_keys);
+    RUN_TEST(test_ranges);
+
+    RUN_TEST(test_benchmark);
+
+    return UNITY_END();
+}
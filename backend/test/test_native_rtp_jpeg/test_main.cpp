@@ -0,0 +1,350 @@
+#include <unity.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "tools/rtp_jpeg.hpp"
+
+static constexpr uint32_t TIMESTAMP = 0x11223344;
+static constexpr uint32_t SSRC      = 0xA1B2C3D4;
+
+struct JpegOptions_s {
+    /// Sampling factors of the luma component, 0x21 for 4:2:2, 0x22 for 4:2:0
+    uint8_t  luma             = 0x22;
+    uint16_t width            = 640;
+    uint16_t height           = 480;
+    uint16_t restart_interval = 0;
+    /// 0xC0 for baseline, 0xC2 for progressive
+    uint8_t sof = 0xC0;
+    /// Precision of the chroma table, 1 for 16-bit
+    uint8_t chroma_precision = 0;
+    size_t  scan_len         = 3000;
+};
+using JpegOptions_t = struct JpegOptions_s;
+
+static void put_segment(std::vector<uint8_t>       &jpeg,
+                        uint8_t                     marker,
+                        const std::vector<uint8_t> &data) {
+    const size_t len = data.size() + 2;
+    jpeg.insert(jpeg.end(),
+                {0xFF, marker, static_cast<uint8_t>(len >> 8), static_cast<uint8_t>(len)});
+    jpeg.insert(jpeg.end(), data.begin(), data.end());
+}
+
+/**
+ * @brief Smallest JPEG `rtp_jpeg_parse` reads, the scan is a pattern without markers
+ *
+ * @note Luma table `i` holds `i + 1`, chroma `i + 101`, to tell them apart
+ */
+static std::vector<uint8_t> make_jpeg(const JpegOptions_t &options) {
+    std::vector<uint8_t> jpeg = {0xFF, 0xD8};
+    put_segment(jpeg, 0xE0, {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0});
+
+    // Both tables in one segment, like the sensor writes them
+    std::vector<uint8_t> dqt = {0x00};
+    for (int i = 0; i < 64; i++) dqt.push_back(i + 1);
+    dqt.push_back(static_cast<uint8_t>(options.chroma_precision << 4 | 0x01));
+    for (int i = 0; i < 64; i++) dqt.push_back(i + 101);
+    if (options.chroma_precision) {
+        for (int i = 0; i < 64; i++) dqt.push_back(0);
+    }
+    put_segment(jpeg, 0xDB, dqt);
+
+    put_segment(jpeg,
+                options.sof,
+                {8,
+                 static_cast<uint8_t>(options.height >> 8),
+                 static_cast<uint8_t>(options.height),
+                 static_cast<uint8_t>(options.width >> 8),
+                 static_cast<uint8_t>(options.width),
+                 3,
+                 1,
+                 options.luma,
+                 0,
+                 2,
+                 0x11,
+                 1,
+                 3,
+                 0x11,
+                 1});
+    if (options.restart_interval) {
+        put_segment(jpeg,
+                    0xDD,
+                    {static_cast<uint8_t>(options.restart_interval >> 8),
+                     static_cast<uint8_t>(options.restart_interval)});
+    }
+    // Contents aren't read, the receiver uses the standard tables
+    put_segment(jpeg, 0xC4, {0x00, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0});
+    put_segment(jpeg, 0xDA, {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0});
+
+    for (size_t i = 0; i < options.scan_len; i++) jpeg.push_back((i * 7) & 0x7F);
+    jpeg.insert(jpeg.end(), {0xFF, 0xD9});
+    return jpeg;
+}
+
+struct Packet_s {
+    std::vector<uint8_t> header;
+    const uint8_t       *payload     = nullptr;
+    size_t               payload_len = 0;
+};
+using Packet_t = struct Packet_s;
+
+static std::vector<Packet_t> packetize(const RtpJpegFrame_t &frame,
+                                       uint16_t             &seq,
+                                       size_t                max_packet) {
+    std::vector<Packet_t> packets;
+    const bool            sent = rtp_jpeg_packetize(
+        frame,
+        seq,
+        TIMESTAMP,
+        SSRC,
+        max_packet,
+        [&](const uint8_t *header, size_t header_len, const uint8_t *payload, size_t payload_len) {
+            packets.push_back({{header, header + header_len}, payload, payload_len});
+            return true;
+        });
+    TEST_ASSERT_TRUE(sent);
+    return packets;
+}
+
+static uint32_t fragment_offset(const Packet_t &packet) {
+    return packet.header[RTP_HEADER_SIZE + 1] << 16 | packet.header[RTP_HEADER_SIZE + 2] << 8 |
+           packet.header[RTP_HEADER_SIZE + 3];
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_parse_420(void) {
+    const std::vector<uint8_t> jpeg = make_jpeg({});
+    RtpJpegFrame_t             frame{};
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(jpeg.data(), jpeg.size(), frame));
+
+    TEST_ASSERT_EQUAL(1, frame.type);
+    TEST_ASSERT_EQUAL(640, frame.width);
+    TEST_ASSERT_EQUAL(480, frame.height);
+    TEST_ASSERT_EQUAL(0, frame.restart_interval);
+    TEST_ASSERT_EQUAL(1, frame.qtables[0][0]);
+    TEST_ASSERT_EQUAL(64, frame.qtables[0][63]);
+    TEST_ASSERT_EQUAL(101, frame.qtables[1][0]);
+    TEST_ASSERT_EQUAL(164, frame.qtables[1][63]);
+    // Scan data runs up to EOI, which is left out
+    TEST_ASSERT_EQUAL(3000, frame.scan_len);
+    TEST_ASSERT_EQUAL_PTR(jpeg.data() + jpeg.size() - 2 - 3000, frame.scan);
+}
+
+void test_parse_422(void) {
+    const std::vector<uint8_t> jpeg = make_jpeg({.luma = 0x21, .width = 320, .height = 240});
+    RtpJpegFrame_t             frame{};
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(jpeg.data(), jpeg.size(), frame));
+
+    TEST_ASSERT_EQUAL(0, frame.type);
+    TEST_ASSERT_EQUAL(320, frame.width);
+    TEST_ASSERT_EQUAL(240, frame.height);
+}
+
+void test_parse_restart_interval(void) {
+    RtpJpegFrame_t frame{};
+
+    const std::vector<uint8_t> jpeg_420 = make_jpeg({.restart_interval = 40});
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(jpeg_420.data(), jpeg_420.size(), frame));
+    TEST_ASSERT_EQUAL(1 + 64, frame.type);
+    TEST_ASSERT_EQUAL(40, frame.restart_interval);
+
+    frame                               = {};
+    const std::vector<uint8_t> jpeg_422 = make_jpeg({.luma = 0x21, .restart_interval = 0x1234});
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(jpeg_422.data(), jpeg_422.size(), frame));
+    TEST_ASSERT_EQUAL(0 + 64, frame.type);
+    TEST_ASSERT_EQUAL(0x1234, frame.restart_interval);
+}
+
+void test_parse_rejects(void) {
+    RtpJpegFrame_t frame{};
+
+    const std::vector<uint8_t> progressive = make_jpeg({.sof = 0xC2});
+    TEST_ASSERT_FALSE(rtp_jpeg_parse(progressive.data(), progressive.size(), frame));
+
+    const std::vector<uint8_t> precision_16 = make_jpeg({.chroma_precision = 1});
+    TEST_ASSERT_FALSE(rtp_jpeg_parse(precision_16.data(), precision_16.size(), frame));
+
+    const std::vector<uint8_t> wide = make_jpeg({.width = 2048, .height = 64});
+    TEST_ASSERT_FALSE(rtp_jpeg_parse(wide.data(), wide.size(), frame));
+
+    const std::vector<uint8_t> tall = make_jpeg({.width = 64, .height = 2048});
+    TEST_ASSERT_FALSE(rtp_jpeg_parse(tall.data(), tall.size(), frame));
+
+    const std::vector<uint8_t> largest = make_jpeg({.width = 2040, .height = 2040});
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(largest.data(), largest.size(), frame));
+
+    // Neither 4:2:2 nor 4:2:0
+    const std::vector<uint8_t> yuv444 = make_jpeg({.luma = 0x11});
+    TEST_ASSERT_FALSE(rtp_jpeg_parse(yuv444.data(), yuv444.size(), frame));
+
+    std::vector<uint8_t> truncated = make_jpeg({});
+    truncated.resize(100);
+    TEST_ASSERT_FALSE(rtp_jpeg_parse(truncated.data(), truncated.size(), frame));
+
+    const uint8_t not_jpeg[] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+    TEST_ASSERT_FALSE(rtp_jpeg_parse(not_jpeg, sizeof(not_jpeg), frame));
+}
+
+void test_packetize(void) {
+    const std::vector<uint8_t> jpeg = make_jpeg({.scan_len = 3000});
+    RtpJpegFrame_t             frame{};
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(jpeg.data(), jpeg.size(), frame));
+
+    static constexpr size_t MAX_PACKET   = 1000;
+    static constexpr size_t FIRST_HEADER = RTP_HEADER_SIZE + RTP_JPEG_HEADER_SIZE +
+                                           RTP_JPEG_QHDR_SIZE + 2 * RTP_JPEG_QTABLE_SIZE;
+    static constexpr size_t HEADER       = RTP_HEADER_SIZE + RTP_JPEG_HEADER_SIZE;
+
+    uint16_t                    seq     = 0xFFFE;
+    const std::vector<Packet_t> packets = packetize(frame, seq, MAX_PACKET);
+
+    // 848 + 980 + 980 + 192
+    TEST_ASSERT_EQUAL(4, packets.size());
+    TEST_ASSERT_EQUAL(0x0002, seq);
+
+    size_t offset = 0;
+    for (size_t i = 0; i < packets.size(); i++) {
+        const Packet_t &packet = packets[i];
+        const bool      first  = i == 0;
+        const bool      last   = i + 1 == packets.size();
+        TEST_ASSERT_EQUAL(first ? FIRST_HEADER : HEADER, packet.header.size());
+
+        // RTP header
+        TEST_ASSERT_EQUAL(0x80, packet.header[0]);
+        TEST_ASSERT_EQUAL(RTP_JPEG_PAYLOAD_TYPE | (last ? 0x80 : 0), packet.header[1]);
+        TEST_ASSERT_EQUAL(static_cast<uint16_t>(0xFFFE + i),
+                          packet.header[2] << 8 | packet.header[3]);
+        const uint8_t rtp_tail[] = {0x11, 0x22, 0x33, 0x44, 0xA1, 0xB2, 0xC3, 0xD4};
+        TEST_ASSERT_EQUAL(0, memcmp(rtp_tail, packet.header.data() + 4, sizeof(rtp_tail)));
+
+        // JPEG header
+        const uint8_t *jpeg_header = packet.header.data() + RTP_HEADER_SIZE;
+        TEST_ASSERT_EQUAL(0, jpeg_header[0]);
+        TEST_ASSERT_EQUAL(offset, fragment_offset(packet));
+        TEST_ASSERT_EQUAL(1, jpeg_header[4]);
+        TEST_ASSERT_EQUAL(255, jpeg_header[5]);
+        TEST_ASSERT_EQUAL(640 / 8, jpeg_header[6]);
+        TEST_ASSERT_EQUAL(480 / 8, jpeg_header[7]);
+
+        // Quantization tables only in front of the first fragment
+        if (first) {
+            const uint8_t *qheader = jpeg_header + RTP_JPEG_HEADER_SIZE;
+            TEST_ASSERT_EQUAL(0, qheader[0]);
+            TEST_ASSERT_EQUAL(0, qheader[1]);
+            TEST_ASSERT_EQUAL(2 * RTP_JPEG_QTABLE_SIZE, qheader[2] << 8 | qheader[3]);
+            TEST_ASSERT_EQUAL(0,
+                              memcmp(qheader + RTP_JPEG_QHDR_SIZE,
+                                     frame.qtables[0],
+                                     RTP_JPEG_QTABLE_SIZE));
+            TEST_ASSERT_EQUAL(0,
+                              memcmp(qheader + RTP_JPEG_QHDR_SIZE + RTP_JPEG_QTABLE_SIZE,
+                                     frame.qtables[1],
+                                     RTP_JPEG_QTABLE_SIZE));
+        }
+
+        // Payload is the scan data itself, in order
+        TEST_ASSERT_EQUAL_PTR(frame.scan + offset, packet.payload);
+        if (!last) TEST_ASSERT_EQUAL(MAX_PACKET, packet.header.size() + packet.payload_len);
+        offset += packet.payload_len;
+    }
+    TEST_ASSERT_EQUAL(frame.scan_len, offset);
+}
+
+void test_packetize_restart_interval(void) {
+    const std::vector<uint8_t> jpeg = make_jpeg({.luma = 0x21, .restart_interval = 0x0102});
+    RtpJpegFrame_t             frame{};
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(jpeg.data(), jpeg.size(), frame));
+
+    uint16_t                    seq     = 0;
+    const std::vector<Packet_t> packets = packetize(frame, seq, 1000);
+    TEST_ASSERT_EQUAL(4, packets.size());
+
+    for (size_t i = 0; i < packets.size(); i++) {
+        const uint8_t *jpeg_header = packets[i].header.data() + RTP_HEADER_SIZE;
+        TEST_ASSERT_EQUAL(64, jpeg_header[4]);
+        TEST_ASSERT_EQUAL((i == 0 ? RTP_JPEG_QHDR_SIZE + 2 * RTP_JPEG_QTABLE_SIZE : 0) +
+                              RTP_HEADER_SIZE + RTP_JPEG_HEADER_SIZE + RTP_JPEG_DRI_SIZE,
+                          packets[i].header.size());
+
+        // Restart header follows the JPEG header in every packet, F = L = 1 and count 0x3FFF
+        const uint8_t *restart = jpeg_header + RTP_JPEG_HEADER_SIZE;
+        TEST_ASSERT_EQUAL(0x0102, restart[0] << 8 | restart[1]);
+        TEST_ASSERT_EQUAL(0xFF, restart[2]);
+        TEST_ASSERT_EQUAL(0xFF, restart[3]);
+
+        if (i == 0) TEST_ASSERT_EQUAL(0, restart[RTP_JPEG_DRI_SIZE]);
+    }
+}
+
+void test_packetize_large_offsets(void) {
+    // Past 16 bits, the third offset byte is used
+    const std::vector<uint8_t> jpeg = make_jpeg({.scan_len = 200000});
+    RtpJpegFrame_t             frame{};
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(jpeg.data(), jpeg.size(), frame));
+
+    uint16_t                    seq     = 0;
+    const std::vector<Packet_t> packets = packetize(frame, seq, 1400);
+
+    size_t offset = 0;
+    size_t marked = 0;
+    for (const Packet_t &packet : packets) {
+        TEST_ASSERT_EQUAL(offset, fragment_offset(packet));
+        offset += packet.payload_len;
+        if (packet.header[1] & 0x80) marked++;
+    }
+    TEST_ASSERT_EQUAL(200000, offset);
+    TEST_ASSERT_EQUAL(1, marked);
+    TEST_ASSERT_TRUE(packets.back().header[1] & 0x80);
+    TEST_ASSERT_EQUAL(packets.size(), seq);
+}
+
+void test_packetize_single_packet(void) {
+    const std::vector<uint8_t> jpeg = make_jpeg({.scan_len = 100});
+    RtpJpegFrame_t             frame{};
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(jpeg.data(), jpeg.size(), frame));
+
+    uint16_t                    seq     = 7;
+    const std::vector<Packet_t> packets = packetize(frame, seq, 1400);
+    TEST_ASSERT_EQUAL(1, packets.size());
+    TEST_ASSERT_EQUAL(100, packets[0].payload_len);
+    TEST_ASSERT_EQUAL(RTP_JPEG_PAYLOAD_TYPE | 0x80, packets[0].header[1]);
+    TEST_ASSERT_EQUAL(8, seq);
+}
+
+void test_packetize_stops(void) {
+    const std::vector<uint8_t> jpeg = make_jpeg({.scan_len = 3000});
+    RtpJpegFrame_t             frame{};
+    TEST_ASSERT_TRUE(rtp_jpeg_parse(jpeg.data(), jpeg.size(), frame));
+
+    uint16_t   seq   = 0;
+    size_t     calls = 0;
+    const bool sent  = rtp_jpeg_packetize(
+        frame, seq, TIMESTAMP, SSRC, 1000, [&](const uint8_t *, size_t, const uint8_t *, size_t) {
+            return ++calls < 2;
+        });
+    TEST_ASSERT_FALSE(sent);
+    TEST_ASSERT_EQUAL(2, calls);
+    // Only the packets that went out advance the sequence number
+    TEST_ASSERT_EQUAL(1, seq);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_parse_420);
+    RUN_TEST(test_parse_422);
+    RUN_TEST(test_parse_restart_interval);
+    RUN_TEST(test_parse_rejects);
+    RUN_TEST(test_packetize);
+    RUN_TEST(test_packetize_restart_interval);
+    RUN_TEST(test_packetize_large_offsets);
+    RUN_TEST(test_packetize_single_packet);
+    RUN_TEST(test_packetize_stops);
+
+    return UNITY_END();
+}
@@ -0,0 +1,120 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "tools/trace_ring.hpp"
+
+static constexpr size_t CAPACITY             = 64;
+static constexpr int    BENCHMARK_ITERATIONS = 1000000;
+static constexpr int    THREADS              = 4;
+static constexpr int    THREAD_EVENTS        = 100000;
+
+static TraceSlot_t slots[CAPACITY];
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_detached(void) {
+    TraceRing ring;
+    ring.record({.name = "ignored"});
+
+    TEST_ASSERT_FALSE(ring.attached());
+    TEST_ASSERT_EQUAL(0, ring.capacity());
+    TEST_ASSERT_EQUAL(0, ring.recorded());
+    TEST_ASSERT_EQUAL(0, ring.for_each([](const TraceEvent_t &) { TEST_FAIL(); }));
+}
+
+void test_order(void) {
+    TraceRing ring;
+    ring.attach(slots, CAPACITY);
+    for (int i = 0; i < 10; i++) ring.record({.name = "event", .start = i, .duration = 1});
+
+    int64_t next = 0;
+    TEST_ASSERT_EQUAL(10, ring.for_each([&next](const TraceEvent_t &event) {
+        TEST_ASSERT_EQUAL_STRING("event", event.name);
+        TEST_ASSERT_EQUAL(next++, event.start);
+    }));
+}
+
+void test_wrap(void) {
+    TraceRing ring;
+    ring.attach(slots, CAPACITY);
+    for (int i = 0; i < 1000; i++) ring.record({.start = i});
+
+    // Only the latest events are kept
+    int64_t next = 1000 - CAPACITY;
+    TEST_ASSERT_EQUAL(1000, ring.recorded());
+    TEST_ASSERT_EQUAL(CAPACITY, ring.for_each([&next](const TraceEvent_t &event) {
+        TEST_ASSERT_EQUAL(next++, event.start);
+    }));
+}
+
+void test_concurrent(void) {
+    TraceRing ring;
+    ring.attach(slots, CAPACITY);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&ring, t] {
+            for (int i = 0; i < THREAD_EVENTS; i++) {
+                ring.record({
+                  .name     = "event",
+                  .start    = i,
+                  .duration = static_cast<uint32_t>(i * 3),
+                  .core     = static_cast<uint8_t>(t),
+                });
+            }
+        });
+    }
+    // Read while the writers are busy, an event is whole or skipped
+    size_t torn = 0;
+    while (ring.recorded() < THREADS * THREAD_EVENTS / 2) {
+        ring.for_each([&torn](const TraceEvent_t &event) {
+            if (event.duration != event.start * 3 || event.core >= THREADS) torn++;
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    TEST_ASSERT_EQUAL(0, torn);
+    TEST_ASSERT_EQUAL(THREADS * THREAD_EVENTS, ring.recorded());
+    TEST_ASSERT_EQUAL(CAPACITY, ring.for_each([](const TraceEvent_t &) {}));
+}
+
+/**
+ * @brief Per-event cost of `record`, on the host
+ */
+void test_benchmark(void) {
+    TraceRing ring;
+    ring.attach(slots, CAPACITY);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        ring.record({.name = "event", .start = i, .duration = 10});
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    const double record_ns =
+        std::chrono::duration<double, std::nano>(end - start).count() / BENCHMARK_ITERATIONS;
+
+    char message[64];
+    snprintf(message, sizeof(message), "record: %.1fns", record_ns);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(BENCHMARK_ITERATIONS, ring.recorded());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_detached);
+    RUN_TEST(test_order);
+    RUN_TEST(test_wrap);
+    RUN_TEST(test_concurrent);
+
+    RUN_TEST(test_benchmark);
+
+    return UNITY_END();
+}
@@ -3,6 +3,7 @@ module make_bundle
 go 1.22.2
 
 require (
+	github.com/andybalholm/brotli v1.1.0
 	github.com/tdewolff/minify/v2 v2.20.32
 	golang.org/x/net v0.25.0
 )
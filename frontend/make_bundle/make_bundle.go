@@ -3,18 +3,30 @@ package main
 // Usage:
 // cd make_bundle
 // go run make_bundle.go -i ../index.html -o ../bundle.html.gz -c
+//
+// With a Brotli variant, ../index.html.br:
+// go run make_bundle.go -i ../index.html -o ../index.html.gz -b
+//
+// Pack bundles into an image of the bundle partition:
+// go run make_bundle.go -p -o ../bundle.bin ../index.html.gz ../index.html.br ../api.html.gz
+// parttool.py write_partition --partition-name bundle --input ../bundle.bin
 
 import (
+	"bytes"
 	"compress/gzip"
+	"encoding/binary"
 	"flag"
 	"fmt"
+	"hash/crc32"
 	"io"
 	"log"
 	"os"
 	"path/filepath"
+	"strings"
 
 	"net/url"
 
+	"github.com/andybalholm/brotli"
 	"golang.org/x/net/html"
 
 	minify "github.com/tdewolff/minify/v2"
@@ -135,7 +147,7 @@ func bundle(root *html.Node, input string) {
 	}
 }
 
-func minifyFile(input string, output string) (err error) {
+func minifyFile(input string, output string, brotliOutput string) (err error) {
 	// Open input file
 	in, err := os.Open(input)
 	if err != nil {
@@ -159,6 +171,20 @@ func minifyFile(input string, output string) (err error) {
 	// Create gzip output writer
 	gz := gzip.NewWriter(out)
 	defer gz.Close()
+	var w io.Writer = gz
+
+	// Create Brotli output writer, for the clients accepting it
+	if brotliOutput != "" {
+		brOut, err := os.Create(brotliOutput)
+		if err != nil {
+			return err
+		}
+		defer brOut.Close()
+
+		br := brotli.NewWriterLevel(brOut, brotli.BestCompression)
+		defer br.Close()
+		w = io.MultiWriter(gz, br)
+	}
 
 	// Bundle JavaScript and CSS files into HTML
 	bundle(doc, input)
@@ -175,10 +201,87 @@ func minifyFile(input string, output string) (err error) {
 	}()
 
 	// Minify HTML
-	if err = minifier.Minify("text/html", gz, ior); err != nil {
+	if err = minifier.Minify("text/html", w, ior); err != nil {
+		return
+	}
+
+	return
+}
+
+// Layout of the bundle partition image, see backend/include/tools/bundle_image.hpp
+const (
+	bundleMagic      = 0x4C444E42 // "BNDL"
+	bundleVersion    = 1
+	bundleNameSize   = 24
+	bundleMaxEntries = 8
+	bundleAlign      = 16
+)
+
+type bundleEntry struct {
+	Name     [bundleNameSize]byte
+	Offset   uint32
+	Size     uint32
+	CRC32    uint32
+	Reserved uint32
+}
+
+type bundleHeader struct {
+	Magic    uint32
+	Version  uint16
+	Count    uint16
+	Size     uint32
+	Reserved uint32
+	Entries  [bundleMaxEntries]bundleEntry
+}
+
+func packBundles(inputs []string, output string, partitionSize int) (err error) {
+	if len(inputs) == 0 || len(inputs) > bundleMaxEntries {
+		return fmt.Errorf("need 1 to %d files to pack, got %d", bundleMaxEntries, len(inputs))
+	}
+
+	header := bundleHeader{
+		Magic:   bundleMagic,
+		Version: bundleVersion,
+		Count:   uint16(len(inputs)),
+	}
+	var data bytes.Buffer
+	offset := binary.Size(header)
+	for i, input := range inputs {
+		b, err := os.ReadFile(input)
+		if err != nil {
+			return err
+		}
+		name := filepath.Base(input)
+		if len(name) >= bundleNameSize {
+			return fmt.Errorf("name too long: %s", name)
+		}
+
+		entry := &header.Entries[i]
+		copy(entry.Name[:], name)
+		entry.Offset = uint32(offset + data.Len())
+		entry.Size = uint32(len(b))
+		entry.CRC32 = crc32.ChecksumIEEE(b)
+		data.Write(b)
+		for data.Len()%bundleAlign != 0 {
+			data.WriteByte(0)
+		}
+		log.Printf("Packed %s: %d bytes at 0x%x, CRC %08x", name, entry.Size, entry.Offset, entry.CRC32)
+	}
+	header.Size = uint32(offset + data.Len())
+	if int(header.Size) > partitionSize {
+		return fmt.Errorf("image of %d bytes doesn't fit the %d bytes partition", header.Size, partitionSize)
+	}
+
+	out, err := os.Create(output)
+	if err != nil {
 		return
 	}
+	defer out.Close()
 
+	if err = binary.Write(out, binary.LittleEndian, &header); err != nil {
+		return
+	}
+	_, err = data.WriteTo(out)
 	return
 }
 
@@ -187,9 +290,20 @@ func main() {
 	input_flag_ptr := flag.String("i", "../index.html", "Input HTML file")
 	output_flag_ptr := flag.String("o", "../bundle.html.gz", "Output HTML file")
 	c_array_flag_ptr := flag.Bool("c", false, "Generate C style array of bytes")
+	pack_flag_ptr := flag.Bool("p", false, "Pack the bundles given as arguments into a bundle partition image")
+	size_flag_ptr := flag.Int("s", 0x80000, "Size of the bundle partition")
+	brotli_flag_ptr := flag.Bool("b", false, "Also write a Brotli variant, the output with a .br extension")
 
 	flag.Parse()
 
+	if *pack_flag_ptr {
+		if err := packBundles(flag.Args(), *output_flag_ptr, *size_flag_ptr); err != nil {
+			log.Fatal(err)
+		}
+		log.Printf("Bundle image created: %s", *output_flag_ptr)
+		return
+	}
+
 	input_flag, err := filepath.Abs(*input_flag_ptr)
 	if err != nil {
 		log.Fatal(err)
@@ -199,9 +313,17 @@ func main() {
 		log.Fatal(err)
 	}
 
-	if err := minifyFile(input_flag, output_flag); err != nil {
+	brotli_output := ""
+	if *brotli_flag_ptr {
+		brotli_output = strings.TrimSuffix(output_flag, filepath.Ext(output_flag)) + ".br"
+	}
+
+	if err := minifyFile(input_flag, output_flag, brotli_output); err != nil {
 		log.Fatal(err)
 	}
+	if brotli_output != "" {
+		log.Printf("Brotli variant created: %s", brotli_output)
+	}
 
 	// Open output file
 	f, err := os.Open(output_flag)